@@ -1,4 +1,8 @@
 #include "libs/mpc.h"
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <errno.h>
 
 /* Code to be compiled on Windows */
 #ifdef _WIN32
@@ -24,6 +28,106 @@ void add_history(char* unused) {}
 #include <editline/history.h>
 #endif
 
+/* Batch mode can run on several threads where there are POSIX threads */
+#ifndef _WIN32
+#define LVAL_JOBS
+#include <pthread.h>
+#endif
+
+/* Storage that each thread has its own copy of */
+#ifdef _MSC_VER
+#define LVAL_THREAD __declspec(thread)
+#else
+#define LVAL_THREAD __thread
+#endif
+
+/*************************************************
+** Every lval built while reading and evaluating **
+** one input is carved out of a bump arena, so   **
+** the whole tree is released in one step by     **
+** lval_arena_reset() once the result has been   **
+** printed. Values that must outlive the input   **
+** are copied out explicitly with lval_copy().   **
+*************************************************/
+
+/* Size of the first block; later blocks double */
+#define LVAL_ARENA_BLOCK (64 * 1024)
+
+/* Every allocation is rounded up to this alignment */
+typedef union { long l; double d; void* p; } lval_align;
+#define LVAL_ALIGN(n) (((n) + sizeof(lval_align) - 1) & ~(sizeof(lval_align) - 1))
+
+typedef struct lval_block {
+  struct lval_block* next;
+  size_t size;
+  size_t used;
+  lval_align data[];
+} lval_block;
+
+typedef struct {
+  // Block currently being bumped, followed by the older ones
+  lval_block* head;
+  // Most recent allocation, which lval_arena_grow can extend in place
+  void* last;
+} lval_arena;
+
+/* Arena used by all of the lval constructors, one per thread */
+static LVAL_THREAD lval_arena region;
+
+void* lval_arena_alloc(lval_arena* a, size_t n) {
+  n = LVAL_ALIGN(n);
+
+  if (a->head == NULL || a->head->size - a->head->used < n) {
+    size_t size = a->head ? a->head->size * 2 : LVAL_ARENA_BLOCK;
+    while (size < n) { size *= 2; }
+
+    lval_block* b = malloc(sizeof(lval_block) + size);
+    b->next = a->head;
+    b->size = size;
+    b->used = 0;
+    a->head = b;
+  }
+
+  a->last = (char*)a->head->data + a->head->used;
+  a->head->used += n;
+  return a->last;
+}
+
+/* Resize p from n to m bytes, in place when p was the last allocation */
+void* lval_arena_grow(lval_arena* a, void* p, size_t n, size_t m) {
+  if (p != NULL && p == a->last &&
+      (char*)p + LVAL_ALIGN(m) <= (char*)a->head->data + a->head->size) {
+    a->head->used = ((char*)p - (char*)a->head->data) + LVAL_ALIGN(m);
+    return p;
+  }
+
+  void* q = lval_arena_alloc(a, m);
+  if (p != NULL) { memcpy(q, p, n < m ? n : m); }
+  return q;
+}
+
+/* Release everything in one go, keeping the largest block for reuse */
+void lval_arena_reset(lval_arena* a) {
+  if (a->head == NULL) { return; }
+
+  lval_block* b = a->head->next;
+  while (b != NULL) {
+    lval_block* next = b->next;
+    free(b);
+    b = next;
+  }
+
+  a->head->next = NULL;
+  a->head->used = 0;
+  a->last = NULL;
+}
+
+void lval_arena_free(lval_arena* a) {
+  lval_arena_reset(a);
+  free(a->head);
+  a->head = NULL;
+}
+
 /*************************************************
 ** The names for the enumerations and structs   **
 ** below can seem intuitive enough; however,    **
@@ -35,130 +139,724 @@ void add_history(char* unused) {}
 enum { LVAL_ERR, LVAL_NUM, LVAL_SYM, LVAL_SEXPR, LVAL_QEXPR };
 
 /* Declare new lisp_value struct */
+/* A small header followed by whichever payload the type uses */
 typedef struct lval {
-  int type;
-  long num;
-  /* Both Error and Symbol types have string data, therefore they are char* */
-  char* err;
-  char* sym;
-  // Count to a list of lval*
+  unsigned char type;
+  // Count of live children (limbs of a Number), and how many slots items has room for
   int count;
-  // Pointer to a list of lval*
-  struct lval** cell;
+  int cap;
+  union {
+    // Interned id of a Symbol, see lval_intern
+    int id;
+    // Sign of a boxed Number, 1 or -1
+    int sign;
+  };
+  union {
+    // Magnitude of a boxed Number, least significant limb first
+    uint32_t* limbs;
+    /* Both Error and Symbol types have string data, therefore they are char* */
+    char* err;
+    char* sym;
+    // First live child, somewhere in items; lval_pop(v, 0) just advances it
+    struct lval** cell;
+  };
+  // Children of an Sexpr or Qexpr, allocated along with the node
+  struct lval* items[];
 } lval;
 
-/* Create a pointer to a new Number type for lval */
-lval* lval_num(long x) {
-  lval* v = malloc(sizeof(lval));
+/*************************************************
+** Small integers (fixnums) are never allocated: **
+** they live in the lval* word itself, shifted   **
+** left by one with the low bit set. Real nodes  **
+** are always aligned, so their low bit is 0.    **
+** Only numbers too wide for a fixnum are boxed. **
+*************************************************/
+
+#define LVAL_FIXNUM_MIN (INTPTR_MIN >> 1)
+#define LVAL_FIXNUM_MAX (INTPTR_MAX >> 1)
+
+int lval_is_fixnum(lval* v) { return ((uintptr_t)v & 1) != 0; }
+
+/* Type of any lval, immediate or not */
+int lval_type(lval* v) { return lval_is_fixnum(v) ? LVAL_NUM : v->type; }
+
+/* Value of a fixnum */
+long lval_to_num(lval* v) { return (long)((intptr_t)v >> 1); }
+
+lval* lval_num(long x);
+
+/*************************************************
+** Numbers too wide for a fixnum are boxed, as   **
+** a sign and a magnitude in 32-bit limbs that   **
+** follow the header. Every operation rebuilds   **
+** its result through lval_big_done(), so a      **
+** value that fits a fixnum is always one, and a **
+** boxed Number is never mutated once built.     **
+*************************************************/
+
+/* Limbs needed to hold any long */
+#define LVAL_LONG_LIMBS ((int)((sizeof(long) * CHAR_BIT + 31) / 32))
+
+/* Products where both operands have at least this many limbs use Karatsuba */
+#define LVAL_KARATSUBA_MIN 32
+
+/* Scratch limbs lval_mag_mul needs when its longer operand has n limbs */
+#define LVAL_MUL_SCRATCH(n) (4 * (n) + 1024)
+
+/* A signed number being worked on, its limbs in the region */
+typedef struct {
+  uint32_t* d;
+  int n;
+  int cap;
+  int neg;
+} lval_big;
+
+/* Compares the magnitudes a and b, both without leading zero limbs */
+static int lval_mag_cmp(const uint32_t* a, int an, const uint32_t* b, int bn) {
+  if (an != bn) { return an < bn ? -1 : 1; }
+  for (int i = an - 1; i >= 0; i--) {
+    if (a[i] != b[i]) { return a[i] < b[i] ? -1 : 1; }
+  }
+  return 0;
+}
+
+/* r = a + b for an >= bn, returning the carry out of the top limb; r may be a or b */
+static uint32_t lval_mag_add(uint32_t* r, const uint32_t* a, int an,
+                             const uint32_t* b, int bn) {
+  uint64_t t = 0;
+  int i = 0;
+  for (; i < bn; i++) { t += (uint64_t)a[i] + b[i]; r[i] = (uint32_t)t; t >>= 32; }
+  for (; i < an; i++) { t += a[i]; r[i] = (uint32_t)t; t >>= 32; }
+  return (uint32_t)t;
+}
+
+/* r = a - b for a >= b; r may be a or b */
+static void lval_mag_sub(uint32_t* r, const uint32_t* a, int an,
+                         const uint32_t* b, int bn) {
+  uint64_t borrow = 0;
+  int i = 0;
+  for (; i < bn; i++) {
+    uint64_t t = (uint64_t)a[i] - b[i] - borrow;
+    r[i] = (uint32_t)t;
+    borrow = t >> 63;
+  }
+  for (; i < an; i++) {
+    uint64_t t = (uint64_t)a[i] - borrow;
+    r[i] = (uint32_t)t;
+    borrow = t >> 63;
+  }
+}
+
+/* a = a * m + c in place, returning the limb carried out of the top */
+static uint32_t lval_mag_muladd1(uint32_t* a, int an, uint32_t m, uint32_t c) {
+  uint64_t t = c;
+  for (int i = 0; i < an; i++) { t += (uint64_t)a[i] * m; a[i] = (uint32_t)t; t >>= 32; }
+  return (uint32_t)t;
+}
+
+/* a = a / d in place, returning a % d */
+static uint32_t lval_mag_divmod1(uint32_t* a, int an, uint32_t d) {
+  uint64_t rem = 0;
+  for (int i = an - 1; i >= 0; i--) {
+    uint64_t t = (rem << 32) | a[i];
+    a[i] = (uint32_t)(t / d);
+    rem = t % d;
+  }
+  return (uint32_t)rem;
+}
+
+/* r = a * b by long multiplication; r has an + bn limbs and overlaps neither */
+static void lval_mag_mul_basic(uint32_t* r, const uint32_t* a, int an,
+                               const uint32_t* b, int bn) {
+  memset(r, 0, sizeof(uint32_t) * (an + bn));
+  for (int i = 0; i < an; i++) {
+    uint64_t x = a[i];
+    uint64_t t = 0;
+    if (x == 0) { continue; }
+    for (int j = 0; j < bn; j++) {
+      t += x * b[j] + r[i + j];
+      r[i + j] = (uint32_t)t;
+      t >>= 32;
+    }
+    r[i + bn] = (uint32_t)t;
+  }
+}
+
+/*
+** r = a * b; r has an + bn limbs and overlaps neither. Large operands are
+** split in half, a = a1 B + a0 and b = b1 B + b0, and multiplied with three
+** half-sized products instead of four:
+**
+**   a b = z2 B^2 + ((a1 + a0)(b1 + b0) - z2 - z0) B + z0
+**
+** where z2 = a1 b1 and z0 = a0 b0 are built directly in r.
+*/
+static void lval_mag_mul(uint32_t* r, const uint32_t* a, int an,
+                         const uint32_t* b, int bn, uint32_t* scratch) {
+  if (an < bn) {
+    const uint32_t* t = a; a = b; b = t;
+    int tn = an; an = bn; bn = tn;
+  }
+
+  if (bn < LVAL_KARATSUBA_MIN) {
+    lval_mag_mul_basic(r, a, an, b, bn);
+    return;
+  }
+
+  /* Lopsided operands are multiplied one bn-limb slice of a at a time */
+  if (an >= 2 * bn) {
+    uint32_t* t = scratch;
+    memset(r, 0, sizeof(uint32_t) * (an + bn));
+    for (int i = 0; i < an; i += bn) {
+      int k = an - i < bn ? an - i : bn;
+      lval_mag_mul(t, a + i, k, b, bn, scratch + 2 * bn);
+      uint32_t c = lval_mag_add(r + i, r + i, k + bn, t, k + bn);
+      for (int j = i + k + bn; c && j < an + bn; j++) { c = ++r[j] == 0; }
+    }
+    return;
+  }
+
+  int h = an / 2;
+  int a1n = an - h;
+  int b1n = bn - h;
+
+  lval_mag_mul(r, a, h, b, h, scratch);
+  lval_mag_mul(r + 2 * h, a + h, a1n, b + h, b1n, scratch);
+
+  /* s = a1 + a0 and t = b1 + b0, each with room for a carry */
+  int sn = a1n + 1;
+  int tn = (b1n > h ? b1n : h) + 1;
+  uint32_t* s = scratch;
+  uint32_t* t = s + sn;
+  uint32_t* u = t + tn;
+  s[a1n] = lval_mag_add(s, a + h, a1n, a, h);
+  if (b1n >= h) {
+    t[b1n] = lval_mag_add(t, b + h, b1n, b, h);
+  } else {
+    t[h] = lval_mag_add(t, b, h, b + h, b1n);
+  }
+
+  /* u = s t - z2 - z0, added into r at B */
+  int un = sn + tn;
+  lval_mag_mul(u, s, sn, t, tn, u + un);
+  lval_mag_sub(u, u, un, r, 2 * h);
+  lval_mag_sub(u, u, un, r + 2 * h, a1n + b1n);
+  if (un > an + bn - h) { un = an + bn - h; }
+  lval_mag_add(r + h, r + h, an + bn - h, u, un);
+}
+
+/*
+** q = u / v and r = u % v for un >= vn >= 2, by Knuth's Algorithm D. q has
+** un - vn + 1 limbs and r has vn.
+*/
+static void lval_mag_divmod(uint32_t* q, uint32_t* r, const uint32_t* u, int un,
+                            const uint32_t* v, int vn) {
+  uint32_t* vs = lval_arena_alloc(&region, sizeof(uint32_t) * vn);
+  uint32_t* us = lval_arena_alloc(&region, sizeof(uint32_t) * (un + 1));
+
+  /* Shift both until the top bit of v is set, so each guess is off by at most 2 */
+  int shift = 0;
+  while (!(v[vn - 1] << shift & 0x80000000u)) { shift++; }
+  for (int i = vn - 1; i > 0; i--) {
+    vs[i] = (uint32_t)(v[i] << shift | (uint64_t)v[i - 1] >> (32 - shift));
+  }
+  vs[0] = v[0] << shift;
+  us[un] = (uint32_t)((uint64_t)u[un - 1] >> (32 - shift));
+  for (int i = un - 1; i > 0; i--) {
+    us[i] = (uint32_t)(u[i] << shift | (uint64_t)u[i - 1] >> (32 - shift));
+  }
+  us[0] = u[0] << shift;
+
+  for (int j = un - vn; j >= 0; j--) {
+    /* Guess the next quotient limb from the top two limbs of what is left */
+    uint64_t num = (uint64_t)us[j + vn] << 32 | us[j + vn - 1];
+    uint64_t qhat = num / vs[vn - 1];
+    uint64_t rhat = num % vs[vn - 1];
+    while (qhat >> 32 || qhat * vs[vn - 2] > (rhat << 32 | us[j + vn - 2])) {
+      qhat--;
+      rhat += vs[vn - 1];
+      if (rhat >> 32) { break; }
+    }
+
+    /* Subtract qhat v, adding v back once if the guess was one too big */
+    int64_t borrow = 0;
+    int64_t t;
+    for (int i = 0; i < vn; i++) {
+      uint64_t p = qhat * vs[i];
+      t = (int64_t)us[i + j] - borrow - (int64_t)(p & 0xFFFFFFFFu);
+      us[i + j] = (uint32_t)t;
+      borrow = (int64_t)(p >> 32) - (t >> 32);
+    }
+    t = (int64_t)us[j + vn] - borrow;
+    us[j + vn] = (uint32_t)t;
+
+    q[j] = (uint32_t)qhat;
+    if (t < 0) {
+      q[j]--;
+      us[j + vn] += lval_mag_add(us + j, us + j, vn, vs, vn);
+    }
+  }
+
+  for (int i = 0; i < vn - 1; i++) {
+    r[i] = (uint32_t)(us[i] >> shift | (uint64_t)us[i + 1] << (32 - shift));
+  }
+  r[vn - 1] = us[vn - 1] >> shift;
+}
+
+/* Make room for n limbs in a */
+static void lval_big_reserve(lval_big* a, int n) {
+  if (n <= a->cap) { return; }
+  int cap = a->cap ? a->cap * 2 : 4;
+  while (cap < n) { cap *= 2; }
+  a->d = lval_arena_grow(&region, a->d, sizeof(uint32_t) * a->n, sizeof(uint32_t) * cap);
+  a->cap = cap;
+}
+
+/* Drop leading zero limbs, so that zero has no limbs and no sign */
+static void lval_big_trim(lval_big* a) {
+  while (a->n > 0 && a->d[a->n - 1] == 0) { a->n--; }
+  if (a->n == 0) { a->neg = 0; }
+}
+
+/* Set a to x */
+static void lval_big_long(lval_big* a, long x) {
+  unsigned long m = x < 0 ? 0UL - (unsigned long)x : (unsigned long)x;
+  lval_big_reserve(a, LVAL_LONG_LIMBS);
+  a->n = 0;
+  a->neg = x < 0;
+  /* Shifted in two steps, since a 32-bit long can't be shifted by 32 */
+  for (; m != 0; m = m >> 16 >> 16) { a->d[a->n++] = (uint32_t)m; }
+}
+
+/* Point a at the value of a Number without copying it; a fixnum is spread into small */
+static void lval_big_view(lval_big* a, lval* v, uint32_t* small) {
+  if (lval_is_fixnum(v)) {
+    a->d = small;
+    a->cap = LVAL_LONG_LIMBS;
+    lval_big_long(a, lval_to_num(v));
+  } else {
+    a->d = v->limbs;
+    a->n = a->cap = v->count;
+    a->neg = v->sign < 0;
+  }
+}
+
+/* Set a to a copy of the value of a Number, which a can then change */
+static void lval_big_set(lval_big* a, lval* v) {
+  uint32_t small[LVAL_LONG_LIMBS];
+  lval_big b;
+  lval_big_view(&b, v, small);
+  lval_big_reserve(a, b.n);
+  memcpy(a->d, b.d, sizeof(uint32_t) * b.n);
+  a->n = b.n;
+  a->neg = b.neg;
+}
+
+/* a = a + b, or a - b if sub is set */
+static void lval_big_add(lval_big* a, const lval_big* b, int sub) {
+  int neg = b->neg ^ (sub && b->n > 0);
+
+  if (a->neg == neg) {
+    int n = a->n > b->n ? a->n : b->n;
+    lval_big_reserve(a, n + 1);
+    a->d[n] = a->n >= b->n ? lval_mag_add(a->d, a->d, a->n, b->d, b->n)
+                           : lval_mag_add(a->d, b->d, b->n, a->d, a->n);
+    a->n = n + 1;
+  } else if (lval_mag_cmp(a->d, a->n, b->d, b->n) >= 0) {
+    lval_mag_sub(a->d, a->d, a->n, b->d, b->n);
+  } else {
+    lval_big_reserve(a, b->n);
+    lval_mag_sub(a->d, b->d, b->n, a->d, a->n);
+    a->n = b->n;
+    a->neg = neg;
+  }
+
+  lval_big_trim(a);
+}
+
+/* a = a * b */
+static void lval_big_mul(lval_big* a, const lval_big* b) {
+  if (a->n == 0 || b->n == 0) {
+    a->n = 0;
+  } else if (b->n == 1) {
+    lval_big_reserve(a, a->n + 1);
+    a->d[a->n] = lval_mag_muladd1(a->d, a->n, b->d[0], 0);
+    a->n++;
+  } else {
+    int n = a->n + b->n;
+    int most = a->n > b->n ? a->n : b->n;
+    int least = a->n < b->n ? a->n : b->n;
+    uint32_t* r = lval_arena_alloc(&region, sizeof(uint32_t) * n);
+    uint32_t* scratch = least < LVAL_KARATSUBA_MIN ? NULL :
+      lval_arena_alloc(&region, sizeof(uint32_t) * LVAL_MUL_SCRATCH(most));
+    lval_mag_mul(r, a->d, a->n, b->d, b->n, scratch);
+    a->d = r;
+    a->n = a->cap = n;
+  }
+
+  a->neg ^= b->neg;
+  lval_big_trim(a);
+}
+
+/* a = a / b, or a % b if mod is set, truncating like C; b is not zero */
+static void lval_big_div(lval_big* a, const lval_big* b, int mod) {
+  if (lval_mag_cmp(a->d, a->n, b->d, b->n) < 0) {
+    if (!mod) { a->n = 0; }
+  } else if (b->n == 1) {
+    uint32_t rem = lval_mag_divmod1(a->d, a->n, b->d[0]);
+    if (mod) { a->d[0] = rem; a->n = 1; }
+    else { a->neg ^= b->neg; }
+  } else {
+    int qn = a->n - b->n + 1;
+    uint32_t* q = lval_arena_alloc(&region, sizeof(uint32_t) * qn);
+    uint32_t* r = lval_arena_alloc(&region, sizeof(uint32_t) * b->n);
+    lval_mag_divmod(q, r, a->d, a->n, b->d, b->n);
+    if (mod) { a->d = r; a->n = a->cap = b->n; }
+    else { a->d = q; a->n = a->cap = qn; a->neg ^= b->neg; }
+  }
+
+  lval_big_trim(a);
+}
+
+/* Box the value of a as a Number lval */
+static lval* lval_big_box(lval_big* a) {
+  lval* v = lval_arena_alloc(&region, sizeof(lval) + sizeof(uint32_t) * a->n);
   v->type = LVAL_NUM;
-  v->num = x;
+  v->count = a->n;
+  v->sign = a->neg ? -1 : 1;
+  v->limbs = (uint32_t*)(v + 1);
+  memcpy(v->limbs, a->d, sizeof(uint32_t) * a->n);
+  return v;
+}
+
+/* The Number lval for a, a fixnum whenever it fits one */
+static lval* lval_big_done(lval_big* a) {
+  lval_big_trim(a);
+
+  if (a->n <= LVAL_LONG_LIMBS) {
+    unsigned long m = 0;
+    for (int i = a->n - 1; i >= 0; i--) { m = m << 16 << 16 | a->d[i]; }
+    if (m <= LONG_MAX) { return lval_num(a->neg ? -(long)m : (long)m); }
+  }
+
+  return lval_big_box(a);
+}
+
+/* Create a Number lval from len bytes of decimal digits at s, after an optional '-' */
+lval* lval_num_read(const char* s, size_t len) {
+  int neg = len > 0 && s[0] == '-';
+  size_t i = neg;
+
+  /* Up to 9 digits (18 with a 64-bit long) can't overflow */
+  if (len - i <= (sizeof(long) >= 8 ? 18 : 9)) {
+    long x = 0;
+    for (; i < len; i++) { x = x * 10 + (s[i] - '0'); }
+    return lval_num(neg ? -x : x);
+  }
+
+  /* Otherwise take 9 digits at a time, the first chunk making up the remainder */
+  lval_big a = { NULL, 0, 0, 0 };
+  lval_big_reserve(&a, (int)((len - i) / 9 + 2));
+  size_t k = (len - i) % 9 ? (len - i) % 9 : 9;
+  while (i < len) {
+    uint32_t chunk = 0;
+    uint32_t scale = 1;
+    for (size_t end = i + k; i < end; i++) {
+      chunk = chunk * 10 + (uint32_t)(s[i] - '0');
+      scale *= 10;
+    }
+    uint32_t c = lval_mag_muladd1(a.d, a.n, scale, chunk);
+    if (c) { a.d[a.n++] = c; }
+    k = 9;
+  }
+  a.neg = neg;
+
+  return lval_big_done(&a);
+}
+
+/* Create a new Number lval, boxing it only if it doesn't fit a fixnum */
+lval* lval_num(long x) {
+  if (x >= LVAL_FIXNUM_MIN && x <= LVAL_FIXNUM_MAX) {
+    return (lval*)(((uintptr_t)(intptr_t)x << 1) | 1);
+  }
+
+  uint32_t small[LVAL_LONG_LIMBS];
+  lval_big a = { small, 0, LVAL_LONG_LIMBS, 0 };
+  lval_big_long(&a, x);
+  return lval_big_box(&a);
+}
+
+/* Error and Symbol nodes keep their string inline, right after the header */
+lval* lval_str(lval_arena* a, int type, const char* s, size_t len) {
+  lval* v = lval_arena_alloc(a, sizeof(lval) + len + 1);
+  char* str = (char*)(v + 1);
+  memcpy(str, s, len);
+  str[len] = '\0';
+  v->type = type;
+
+  if (type == LVAL_ERR) { v->err = str; }
+  if (type == LVAL_SYM) { v->sym = str; }
 
   return v;
 }
 
 /* Create a pointer to a new Error lval */
 lval* lval_err(char* m) {
-  lval* v = malloc(sizeof(lval));
-  v->type = LVAL_ERR;
-  v->err = malloc(strlen(m) + 1);
-  strcpy(v->err, m);
+  return lval_str(&region, LVAL_ERR, m, strlen(m));
+}
 
-  return v;
+/*************************************************
+** Symbols are interned: each distinct name is   **
+** stored once, in a node that lives for the     **
+** whole run, so symbols compare by pointer and  **
+** carry a small integer id. The builtins are    **
+** interned first, in this order, so that their  **
+** ids double as operator codes.                 **
+*************************************************/
+
+enum { SYM_ADD, SYM_SUB, SYM_MUL, SYM_DIV, SYM_MOD,
+       SYM_LIST, SYM_HEAD, SYM_TAIL, SYM_JOIN, SYM_EVAL, SYM_BUILTINS };
+
+static const char* builtin_names[SYM_BUILTINS] = {
+  "+", "-", "*", "/", "%", "list", "head", "tail", "join", "eval"
+};
+
+/* Open-addressed hash table of interned Symbol nodes */
+static lval_arena symbols;
+static lval** symtab;
+static int symtab_size;
+static int symtab_count;
+
+static unsigned long lval_sym_hash(const char* s, size_t len) {
+  /* FNV-1a */
+  unsigned long h = 2166136261UL;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ (unsigned char)s[i]) * 16777619UL;
+  }
+  return h;
 }
 
+static void lval_symtab_grow(void) {
+  int size = symtab_size ? symtab_size * 2 : 64;
+  lval** table = calloc(size, sizeof(lval*));
 
-/* Create a pointer to a new Symbol lval */
-lval* lval_sym(char* s) {
-  lval* v = malloc(sizeof(lval));
-  v->type = LVAL_SYM;
-  v->sym = malloc(strlen(s) + 1);
-  strcpy(v->sym, s);
+  for (int i = 0; i < symtab_size; i++) {
+    lval* v = symtab[i];
+    if (v == NULL) { continue; }
+    unsigned long h = lval_sym_hash(v->sym, strlen(v->sym));
+    while (table[h & (size - 1)] != NULL) { h++; }
+    table[h & (size - 1)] = v;
+  }
+
+  free(symtab);
+  symtab = table;
+  symtab_size = size;
+}
+
+/* Returns the one Symbol lval named by the len bytes at s */
+lval* lval_intern(const char* s, size_t len) {
+  /* Keep the table at most half full */
+  if (symtab_count * 2 >= symtab_size) { lval_symtab_grow(); }
+
+  unsigned long h = lval_sym_hash(s, len);
+  lval* v;
+  while ((v = symtab[h & (symtab_size - 1)]) != NULL) {
+    if (strncmp(v->sym, s, len) == 0 && v->sym[len] == '\0') { return v; }
+    h++;
+  }
+
+  v = lval_str(&symbols, LVAL_SYM, s, len);
+  v->id = symtab_count++;
+  symtab[h & (symtab_size - 1)] = v;
 
   return v;
 }
 
+void lval_intern_builtins(void) {
+  for (int i = 0; i < SYM_BUILTINS; i++) {
+    lval_intern(builtin_names[i], strlen(builtin_names[i]));
+  }
+}
+
+void lval_symtab_free(void) {
+  free(symtab);
+  symtab = NULL;
+  symtab_size = symtab_count = 0;
+  lval_arena_free(&symbols);
+}
+
+/* Returns the interned Symbol lval for s */
+lval* lval_sym(char* s) {
+  return lval_intern(s, strlen(s));
+}
+
 /* Create a pointer to a new, empty Sexpr lval */
 lval* lval_sexpr(void) {
-  lval* v = malloc(sizeof(lval));
+  lval* v = lval_arena_alloc(&region, sizeof(lval));
   v->type = LVAL_SEXPR;
   v->count = 0;
-  v->cell = NULL;
+  v->cap = 0;
+  v->cell = v->items;
 
   return v;
 }
 
 lval* lval_qexpr(void) {
-  lval* v = malloc(sizeof(lval));
+  lval* v = lval_arena_alloc(&region, sizeof(lval));
   v->type = LVAL_QEXPR;
   v->count = 0;
-  v->cell = NULL;
+  v->cap = 0;
+  v->cell = v->items;
   
   return v;
 }
 
-void lval_del(lval* v) {
+/* Bytes taken by a list node with room for n children */
+#define LVAL_LIST_SIZE(n) (sizeof(lval) + sizeof(lval*) * (n))
+
+/* Deep copy v into arena a, so that it survives a reset of the region */
+lval* lval_copy(lval_arena* a, lval* v) {
+  if (lval_is_fixnum(v)) { return v; }
+
+  lval* x = NULL;
 
   switch (v->type) {
 
-    /* Break if LVAL_NUM */
-    case LVAL_NUM: break;
+    case LVAL_NUM:
+      x = lval_arena_alloc(a, sizeof(lval) + sizeof(uint32_t) * v->count);
+      *x = *v;
+      x->limbs = (uint32_t*)(x + 1);
+      memcpy(x->limbs, v->limbs, sizeof(uint32_t) * v->count);
+    break;
 
-    /* Free string data from LVAL_ERR and LVAL_SYM */
-    case LVAL_ERR: free(v->err); break;
-    case LVAL_SYM: free(v->sym); break;
+    /* Copy string data from LVAL_ERR; interned symbols are shared */
+    case LVAL_ERR: x = lval_str(a, LVAL_ERR, v->err, strlen(v->err)); break;
+    case LVAL_SYM: x = v; break;
 
-    /* If LVAL_QEXPR or LVAL_SEXPR then delete all elements within */
+    /* If LVAL_QEXPR or LVAL_SEXPR then copy all elements within */
     case LVAL_QEXPR:
     case LVAL_SEXPR:
+      x = lval_arena_alloc(a, LVAL_LIST_SIZE(v->count));
+      x->type = v->type;
+      x->count = v->count;
+      x->cap = v->count;
+      x->cell = x->items;
       for (int i = 0; i < v->count; i++) {
-        lval_del(v->cell[i]);
+        x->cell[i] = lval_copy(a, v->cell[i]);
       }
-
-      /* Free the memory allocated to the pointers */
-      free(v->cell);
     break;
   }
 
-  /* Free the allocated memory for lval struct */
-  free(v);
+  return x;
+}
+
+/* Makes room for n more children at the end of v; as they live inline, v may move */
+lval* lval_reserve(lval* v, int n) {
+  int start = v->cell - v->items;
+  if (start + v->count + n <= v->cap) { return v; }
+
+  if (v->count + n <= v->cap && start >= v->cap / 2) {
+    /* At least half the slots were popped off the front, so reuse them */
+    memmove(v->items, v->cell, sizeof(lval*) * v->count);
+    start = 0;
+  } else {
+    /* Otherwise at least double, so that N appends cost O(N) copying in total */
+    int cap = v->cap ? v->cap * 2 : 4;
+    while (cap < start + v->count + n) { cap *= 2; }
+    v = lval_arena_grow(&region, v, LVAL_LIST_SIZE(v->cap), LVAL_LIST_SIZE(cap));
+    v->cap = cap;
+  }
+
+  /* The node may have moved, so point cell back into its own items */
+  v->cell = v->items + start;
+  return v;
 }
 
+/* Appends x to v; v may move */
 lval* lval_add(lval* v, lval* x) {
+  v = lval_reserve(v, 1);
   v->count++;
-  v->cell = realloc(v->cell, sizeof(lval*) * v->count);
   v->cell[v->count-1] = x;
 
   return v;
 }
 
+/* Joins y onto the end of x, reusing whichever node makes that cheapest */
+lval* lval_join(lval* x, lval* y) {
+
+  // If y is the longer list and has room in front from earlier pops, slide x in there
+  if (x->count < y->count && y->cell - y->items >= x->count) {
+    y->cell -= x->count;
+    memcpy(y->cell, x->cell, sizeof(lval*) * x->count);
+    y->count += x->count;
+    y->type = x->type;
+    return y;
+  }
+
+  // Otherwise x's children stay where they are, and only y's are copied
+  x = lval_reserve(x, y->count);
+  memcpy(x->cell + x->count, y->cell, sizeof(lval*) * y->count);
+  x->count += y->count;
+  return x;
+}
+
 lval* lval_pop(lval* v, int i) {
   // Find the item at child 'i'
   lval* x = v->cell[i];
 
-  // Shifts the memory after child 'i' to the top
-  memmove(&v->cell[i], &v->cell[i+1],
-  sizeof(lval*) * (v->count-i-1));
+  // Closes the gap from whichever side is shorter, so popping the front is O(1)
+  if (i < v->count / 2) {
+    memmove(&v->cell[1], &v->cell[0], sizeof(lval*) * i);
+    v->cell++;
+  } else {
+    memmove(&v->cell[i], &v->cell[i+1],
+    sizeof(lval*) * (v->count-i-1));
+  }
 
   // Decrease the count of items in the list
   v->count--;
-
-  // Reallocate the used memory
-  v->cell = realloc(v->cell, sizeof(lval*) * v->count);
   return x;
 }
 
+/* Takes child 'i'; the rest of v goes when the region is reset */
 lval* lval_take(lval* v, int i) {
-  lval* x = lval_pop(v, i);
-  lval_del(v);
-  return x;
+  return lval_pop(v, i);
 }
 
+/* Growable buffer that a batch worker prints its results into */
+typedef struct {
+  char* data;
+  size_t len;
+  size_t cap;
+} lval_text;
+
+/* Where this thread's lval_print goes; stdout when NULL */
+static LVAL_THREAD lval_text* output;
+
+void lval_write(const char* s, size_t n) {
+  if (output == NULL) {
+    if (n == 1) { putchar(*s); } else { fwrite(s, 1, n, stdout); }
+    return;
+  }
+
+  if (output->len + n > output->cap) {
+    size_t cap = output->cap ? output->cap * 2 : 4096;
+    while (cap < output->len + n) { cap *= 2; }
+    output->data = realloc(output->data, cap);
+    output->cap = cap;
+  }
+  memcpy(output->data + output->len, s, n);
+  output->len += n;
+}
+
+void lval_write_str(const char* s) { lval_write(s, strlen(s)); }
+
 /* Forward declaration of lval_print function on line */
 /* This is done in order to call lval_print in the lval_expr_print function before the arguments get defined */
 void lval_print(lval* v);
 
 void lval_expr_print(lval* v, char open, char close) {
-  putchar(open);
+  lval_write(&open, 1);
   for (int i = 0; i < v->count; i++) {
 
     /* Prints value */
@@ -166,131 +864,338 @@ void lval_expr_print(lval* v, char open, char close) {
 
     /* If the last element has trailing space, doesn't print */
     if (i != (v->count - 1)) {
-      putchar(' ');
+      lval_write(" ", 1);
     }
   }
-  putchar(close);
+  lval_write(&close, 1);
+}
+
+/* Print a boxed Number in base 10, peeling off 9 digits at a time from the bottom */
+void lval_big_print(lval* v) {
+  char num[32];
+  lval_big a = { NULL, 0, 0, 0 };
+  lval_big_set(&a, v);
+
+  uint32_t* parts = lval_arena_alloc(&region, sizeof(uint32_t) * (a.n + a.n / 8 + 1));
+  int k = 0;
+  while (a.n > 0) {
+    parts[k++] = lval_mag_divmod1(a.d, a.n, 1000000000);
+    lval_big_trim(&a);
+  }
+
+  if (v->sign < 0) { lval_write("-", 1); }
+  lval_write(num, sprintf(num, "%u", (unsigned)parts[k - 1]));
+  for (int i = k - 2; i >= 0; i--) {
+    lval_write(num, sprintf(num, "%09u", (unsigned)parts[i]));
+  }
 }
 
 void lval_print(lval* v) {
-  switch(v->type) {
+  char num[32];
+
+  switch(lval_type(v)) {
 
-    case LVAL_NUM:   printf("%li", v->num); break;
-    case LVAL_ERR:   printf("Error! %s", v->err); break;
-    case LVAL_SYM:   printf("%s", v->sym); break;
+    case LVAL_NUM:
+      if (lval_is_fixnum(v)) {
+        lval_write(num, sprintf(num, "%li", lval_to_num(v)));
+      } else {
+        lval_big_print(v);
+      }
+    break;
+    case LVAL_ERR:   lval_write_str("Error! "); lval_write_str(v->err); break;
+    case LVAL_SYM:   lval_write_str(v->sym); break;
     case LVAL_SEXPR: lval_expr_print(v, '(', ')'); break;
     case LVAL_QEXPR: lval_expr_print(v, '{', '}'); break;
   }
 }
 
-void lval_println(lval* v) { lval_print(v); putchar('\n'); }
+void lval_println(lval* v) { lval_print(v); lval_write("\n", 1); }
 
 #define LASSERT(args, cond, err) \
-  if (!(cond)) { lval_del(args); return lval_err(err); }
+  if (!(cond)) { return lval_err(err); }
+
+/* Checked long arithmetic: each returns 1 on overflow, and only sets *r otherwise */
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_add_overflow)
+#define LVAL_OVERFLOW_BUILTINS
+#endif
+#elif defined(__GNUC__) && __GNUC__ >= 5
+#define LVAL_OVERFLOW_BUILTINS
+#endif
+
+static int lval_add_overflow(long a, long b, long* r) {
+  long t;
+#ifdef LVAL_OVERFLOW_BUILTINS
+  if (__builtin_add_overflow(a, b, &t)) { return 1; }
+#else
+  if (b > 0 ? a > LONG_MAX - b : a < LONG_MIN - b) { return 1; }
+  t = a + b;
+#endif
+  *r = t;
+  return 0;
+}
 
-lval* builtin_op(lval* a, char* op) {
+static int lval_sub_overflow(long a, long b, long* r) {
+  long t;
+#ifdef LVAL_OVERFLOW_BUILTINS
+  if (__builtin_sub_overflow(a, b, &t)) { return 1; }
+#else
+  if (b < 0 ? a > LONG_MAX + b : a < LONG_MIN + b) { return 1; }
+  t = a - b;
+#endif
+  *r = t;
+  return 0;
+}
+
+static int lval_mul_overflow(long a, long b, long* r) {
+  long t;
+#ifdef LVAL_OVERFLOW_BUILTINS
+  if (__builtin_mul_overflow(a, b, &t)) { return 1; }
+#else
+  if (a > 0 ? (b > 0 ? a > LONG_MAX / b : b < LONG_MIN / a)
+            : (b > 0 ? a < LONG_MIN / b : (a != 0 && b < LONG_MAX / a))) {
+    return 1;
+  }
+  t = a * b;
+#endif
+  *r = t;
+  return 0;
+}
+
+/* Carries on folding from argument i with big numbers, acc holding the arguments before it */
+static lval* lval_fold_big(int op, lval_big* acc, lval** c, int i, int n) {
+  uint32_t small[LVAL_LONG_LIMBS];
+  lval_big b;
+
+  for (; i < n; i++) {
+    lval_big_view(&b, c[i], small);
+    switch (op) {
+      case SYM_ADD: lval_big_add(acc, &b, 0); break;
+      case SYM_SUB: lval_big_add(acc, &b, 1); break;
+      case SYM_MUL: lval_big_mul(acc, &b); break;
+
+      case SYM_DIV:
+        if (b.n == 0) { return lval_err("Error: you can't divide by Zero!"); }
+        lval_big_div(acc, &b, 0);
+      break;
+
+      case SYM_MOD:
+        if (b.n == 0) { return lval_err("Error: cannot perform modulus with Zero!"); }
+        lval_big_div(acc, &b, 1);
+      break;
+    }
+  }
+
+  return lval_big_done(acc);
+}
+
+/* Folds the n arguments at c with op, the interned id of the operator symbol */
+lval* lval_fold(int op, lval** c, int n) {
 
   // Checks that all arguments are numbers
-  for (int i = 0; i < a->count; i++) {
-    if (a->cell[i]->type != LVAL_NUM) {
-      lval_del(a);
+  for (int i = 0; i < n; i++) {
+    if (lval_type(c[i]) != LVAL_NUM) {
       return lval_err("Cannot operate on a non-number!");
     }
   }
 
-  // Pops the first element
-  lval* x = lval_pop(a, 0);
+  // Folds fixnums into a plain long, left to right, until something overflows
+  lval_big acc = { NULL, 0, 0, 0 };
+  int i = 1;
 
-  // If there are no arguments and sub then perform a unary negation
-  if ((strcmp(op, "-") == 0) && a->count == 0) {
-    x->num = -x->num;
+  if (!lval_is_fixnum(c[0])) {
+    lval_big_set(&acc, c[0]);
+    // If there are no arguments and sub then perform a unary negation
+    if (op == SYM_SUB && n == 1) { acc.neg = !acc.neg; }
+    return lval_fold_big(op, &acc, c, i, n);
   }
 
-  // While further elements remain
-  while (a->count > 0) {
+  long x = lval_to_num(c[0]);
+  long r;
 
-    // Pops the next element as before
-    lval* y = lval_pop(a, 0);
+  // The operator is resolved once here, and each one gets its own tight loop
+  switch (op) {
 
-    if (strcmp(op, "+") == 0) { x->num += y->num; }
-    if (strcmp(op, "-") == 0) { x->num -= y->num; }
-    if (strcmp(op, "*") == 0) { x->num *= y->num; }
+    case SYM_ADD:
+      for (; i < n && lval_is_fixnum(c[i]); i++) {
+        if (lval_add_overflow(x, lval_to_num(c[i]), &r)) { break; }
+        x = r;
+      }
+    break;
 
-    if (strcmp(op, "/") == 0) {
-      if (y->num == 0) {
-        lval_del(x); lval_del(y);
-        x = lval_err("Error: you can't divide by Zero!"); break;
+    case SYM_SUB:
+      // Where long is narrower than intptr_t (LLP64) a fixnum can be LONG_MIN, so negating is checked too
+      if (n == 1 && lval_sub_overflow(0, x, &r)) {
+        lval_big_long(&acc, x);
+        acc.neg = !acc.neg;
+        return lval_fold_big(op, &acc, c, i, n);
       }
-      x->num /= y->num;
-    }
+      if (n == 1) { x = r; }
+      for (; i < n && lval_is_fixnum(c[i]); i++) {
+        if (lval_sub_overflow(x, lval_to_num(c[i]), &r)) { break; }
+        x = r;
+      }
+    break;
 
-    if (strcmp(op, "%") == 0) {
-      if (y->num == 0) {
-        lval_del(x); lval_del(y);
-        x = lval_err("Error: cannot perform modulus with Zero!"); break;
+    case SYM_MUL:
+      for (; i < n && lval_is_fixnum(c[i]); i++) {
+        if (lval_mul_overflow(x, lval_to_num(c[i]), &r)) { break; }
+        x = r;
       }
-      x->num = x->num % y->num;
-    }
+    break;
 
-    lval_del(y);
+    case SYM_DIV:
+      for (; i < n && lval_is_fixnum(c[i]); i++) {
+        long y = lval_to_num(c[i]);
+        if (y == 0) {
+          return lval_err("Error: you can't divide by Zero!");
+        }
+        if (y == -1 && x == LONG_MIN) { break; }
+        x /= y;
+      }
+    break;
+
+    case SYM_MOD:
+      for (; i < n && lval_is_fixnum(c[i]); i++) {
+        long y = lval_to_num(c[i]);
+        if (y == 0) {
+          return lval_err("Error: cannot perform modulus with Zero!");
+        }
+        if (y == -1 && x == LONG_MIN) { break; }
+        x = x % y;
+      }
+    break;
   }
 
-  lval_del(a);
-  return x;
+  if (i == n) { return lval_num(x); }
+
+  // Otherwise the rest is done with big numbers, starting from what was folded so far
+  lval_big_long(&acc, x);
+  return lval_fold_big(op, &acc, c, i, n);
 }
 
+lval* builtin_op(lval* a, int op) { return lval_fold(op, a->cell, a->count); }
+
+lval* builtin_add(lval* a) { return builtin_op(a, SYM_ADD); }
+lval* builtin_sub(lval* a) { return builtin_op(a, SYM_SUB); }
+lval* builtin_mul(lval* a) { return builtin_op(a, SYM_MUL); }
+lval* builtin_div(lval* a) { return builtin_op(a, SYM_DIV); }
+lval* builtin_mod(lval* a) { return builtin_op(a, SYM_MOD); }
+
 lval* lval_eval(lval* v);
 
+/*************************************************
+** A list's children are the window cell[0] to  **
+** cell[count-1] onto its items, so head and    **
+** tail just narrow that window over the list   **
+** they are handed: O(1), with nothing copied   **
+** or freed. Arguments are never shared, since  **
+** each value is consumed exactly once.         **
+*************************************************/
+
 lval* builtin_head(lval* a) {
   // Checks for Error conditions
   if (a->count != 1) {
-    lval_del(a);
     return lval_err("Function 'head' has too many arguments!");
   }
   
-  if (a->cell[0]->type != LVAL_QEXPR) {
-    lval_del(a);
+  if (lval_type(a->cell[0]) != LVAL_QEXPR) {
     return lval_err("Function 'head' passed with incorrect types!");
   }
   
   if (a->cell[0]->count == 0) {
-    lval_del(a);
     return lval_err("Function 'head' passed with {}!");
   }
   
   // Takes first argument if no errors 
   lval* v = lval_take(a, 0);
   
-  // Delete all elements that are not the head and return v
-  while (v->count > 1) { lval_del(lval_pop(v, 1)); }
+  // Drop all elements that are not the head and return v
+  v->count = 1;
   return v;
 }
 
 lval* builtin_tail(lval* a) {
   // Checks for Error conditions
   if (a->count != 1) {
-    lval_del(a);
     return lval_err("Function 'tail' has too many arguments!");
   }
   
-  if (a->cell[0]->type != LVAL_QEXPR) {
-    lval_del(a);
+  if (lval_type(a->cell[0]) != LVAL_QEXPR) {
     return lval_err("Function 'tail' passed with incorrect types!");
   }
   
   if (a->cell[0]->count == 0) {
-    lval_del(a);
     return lval_err("Function 'tail' passed with {}!");
   }
   
   // Takes first argument if no errors
   lval* v = lval_take(a, 0);
   
-  // Delete the first element and return v
-  lval_del(lval_pop(v, 0));
+  // Drop the first element and return v
+  lval_pop(v, 0);
   return v;
 }
 
+lval* builtin_list(lval* a) {
+  // The arguments already are the list, so just quote them
+  a->type = LVAL_QEXPR;
+  return a;
+}
+
+lval* builtin_eval(lval* a) {
+  // Checks for Error conditions
+  LASSERT(a, a->count == 1,
+    "Function 'eval' has too many arguments!");
+  LASSERT(a, lval_type(a->cell[0]) == LVAL_QEXPR,
+    "Function 'eval' passed with incorrect types!");
+
+  // Evaluates the Q-Expression as an S-Expression
+  lval* x = lval_take(a, 0);
+  x->type = LVAL_SEXPR;
+  return lval_eval(x);
+}
+
+lval* builtin_join(lval* a) {
+  // Checks for Error conditions
+  for (int i = 0; i < a->count; i++) {
+    LASSERT(a, lval_type(a->cell[i]) == LVAL_QEXPR,
+      "Function 'join' passed with incorrect types!");
+  }
+
+  // Joins every following list onto the first
+  lval* x = lval_pop(a, 0);
+  while (a->count > 0) {
+    x = lval_join(x, lval_pop(a, 0));
+  }
+
+  return x;
+}
+
+/* Builtins indexed by the interned id of their symbol */
+typedef lval*(*lbuiltin)(lval*);
+
+lbuiltin builtins[SYM_BUILTINS] = {
+  builtin_add, builtin_sub, builtin_mul, builtin_div, builtin_mod,
+  builtin_list, builtin_head, builtin_tail, builtin_join, builtin_eval
+};
+
+/* Calls the builtin named by the first element of v on the rest */
+lval* lval_apply(lval* v) {
+
+  // Checks first element is a Symbol
+  lval* f = lval_pop(v, 0);
+  if (lval_type(f) != LVAL_SYM) {
+    return lval_err("S-expression does not start with a symbol!");
+  }
+
+  // Dispatches on the symbol's id, which for builtins indexes the table
+  if (f->id >= SYM_BUILTINS) {
+    return lval_err("S-expression does not start with a builtin!");
+  }
+  return builtins[f->id](v);
+}
+
 lval* lval_eval_sexpr(lval* v) {
 
   /* Evaluates the S-Expression's children */
@@ -300,7 +1205,7 @@ lval* lval_eval_sexpr(lval* v) {
 
   // Checks for Errors
   for (int i= 0; i < v->count; i++) {
-    if (v->cell[i]->type == LVAL_ERR) { return lval_take(v, i); }
+    if (lval_type(v->cell[i]) == LVAL_ERR) { return lval_take(v, i); }
   }
 
   // Returns empty Expression
@@ -309,49 +1214,230 @@ lval* lval_eval_sexpr(lval* v) {
   // Returns single Expression
   if (v->count == 1) { return lval_take(v, 0); }
 
-  // Checks first element is a Symbol
-  lval* f = lval_pop(v, 0);
-  if (f->type != LVAL_SYM) {
-    lval_del(f); lval_del(v);
-
-    return lval_err("S-expression does not start with a symbol!");
-  }
-
-  // Call builtin function with the operator
-  lval* result = builtin_op(v, f->sym);
-  lval_del(f);
-
-  return result;
+  return lval_apply(v);
 }
 
 lval* lval_eval(lval* v) {
   // Evaluate S-expressions
-  if (v->type == LVAL_SEXPR) { return lval_eval_sexpr(v); }
+  if (lval_type(v) == LVAL_SEXPR) { return lval_eval_sexpr(v); }
 
   // For all other lval types
   return v;
 }
 
+/*************************************************
+** Bytecode. lval_compile lowers an expression  **
+** to a flat chunk of int code words, which the **
+** stack machine in lval_run executes without   **
+** touching the tree again. Arithmetic with a   **
+** builtin at its head becomes one counted      **
+** opcode; anything only known at runtime (a    **
+** computed head, eval, the list builtins) goes **
+** through the same builtins[] table.           **
+*************************************************/
+
+/* OP_ADD to OP_MOD are in the same order as SYM_ADD to SYM_MOD */
+enum {
+  OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+  // Push constant k; OP_QUOTE pushes a fresh copy, as builtins mutate lists
+  OP_CONST, OP_QUOTE,
+  // Call builtin id with the top n values as arguments
+  OP_CALL,
+  // Call whatever the top n values start with, checked at runtime
+  OP_APPLY,
+  OP_RET
+};
+
+typedef struct {
+  // Where the chunk's code and constants are allocated
+  lval_arena* arena;
+  int* code;
+  int count;
+  int cap;
+  // Constants referenced by OP_CONST and OP_QUOTE
+  lval** consts;
+  int consts_count;
+  int consts_cap;
+  // Stack depth while compiling, and the most lval_run will need
+  int depth;
+  int max_depth;
+} lval_chunk;
+
+void lval_emit(lval_chunk* c, int word) {
+  if (c->count == c->cap) {
+    int cap = c->cap ? c->cap * 2 : 16;
+    c->code = lval_arena_grow(c->arena, c->code, sizeof(int) * c->cap, sizeof(int) * cap);
+    c->cap = cap;
+  }
+  c->code[c->count++] = word;
+}
+
+void lval_emit_const(lval_chunk* c, int op, lval* v) {
+  if (c->consts_count == c->consts_cap) {
+    int cap = c->consts_cap ? c->consts_cap * 2 : 8;
+    c->consts = lval_arena_grow(c->arena, c->consts,
+      sizeof(lval*) * c->consts_cap, sizeof(lval*) * cap);
+    c->consts_cap = cap;
+  }
+  c->consts[c->consts_count] = v;
+
+  lval_emit(c, op);
+  lval_emit(c, c->consts_count++);
+  if (++c->depth > c->max_depth) { c->max_depth = c->depth; }
+}
+
+/* Mirrors lval_eval_sexpr case by case, so both evaluators agree */
+void lval_compile_expr(lval_chunk* c, lval* v) {
+
+  switch (lval_type(v)) {
+
+    case LVAL_SEXPR: {
+      // Empty and single Expressions
+      if (v->count == 0) { lval_emit_const(c, OP_QUOTE, v); return; }
+      if (v->count == 1) { lval_compile_expr(c, v->cell[0]); return; }
+
+      lval* f = v->cell[0];
+      int n = v->count - 1;
+
+      // A builtin head is resolved now, and only its arguments are pushed
+      if (lval_type(f) == LVAL_SYM && f->id < SYM_BUILTINS) {
+        for (int i = 1; i <= n; i++) { lval_compile_expr(c, v->cell[i]); }
+
+        if (f->id <= SYM_MOD) {
+          lval_emit(c, OP_ADD + f->id);
+        } else {
+          lval_emit(c, OP_CALL);
+          lval_emit(c, f->id);
+        }
+        lval_emit(c, n);
+      } else {
+        for (int i = 0; i <= n; i++) { lval_compile_expr(c, v->cell[i]); }
+
+        lval_emit(c, OP_APPLY);
+        lval_emit(c, ++n);
+      }
+
+      c->depth -= n - 1;
+    }
+    break;
+
+    // Q-Expressions are data, copied each run
+    case LVAL_QEXPR: lval_emit_const(c, OP_QUOTE, v); break;
+
+    // Numbers, symbols and errors are never mutated, so are pushed as they are
+    default: lval_emit_const(c, OP_CONST, v); break;
+  }
+}
+
+/* Compile v into arena a, which should hold v as well since the chunk points into it */
+lval_chunk* lval_compile(lval_arena* a, lval* v) {
+  lval_chunk* c = lval_arena_alloc(a, sizeof(lval_chunk));
+  memset(c, 0, sizeof(lval_chunk));
+  c->arena = a;
+
+  lval_compile_expr(c, v);
+  lval_emit(c, OP_RET);
+
+  return c;
+}
+
+/* Dispatch with computed goto where the compiler has it, else a switch */
+#ifdef __GNUC__
+#define VM_SWITCH()    VM_NEXT();
+#define VM_CASE(op)    L_##op
+#define VM_NEXT()      goto *labels[*ip++]
+#else
+#define VM_SWITCH()    for (;;) switch (*ip++)
+#define VM_CASE(op)    case op
+#define VM_NEXT()      break
+#endif
+
+/* Evaluation is pure, so the first error raised is the final result */
+#define VM_PUSH(x) {                                   \
+  lval* r = (x);                                       \
+  if (lval_type(r) == LVAL_ERR) { return r; }          \
+  *sp++ = r;                                           \
+}
+
+lval* lval_run(lval_chunk* c) {
+
+#ifdef __GNUC__
+  static void* labels[] = {
+    &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV, &&L_OP_MOD,
+    &&L_OP_CONST, &&L_OP_QUOTE, &&L_OP_CALL, &&L_OP_APPLY, &&L_OP_RET
+  };
+#endif
+
+  lval** sp = lval_arena_alloc(&region, sizeof(lval*) * c->max_depth);
+  int* ip = c->code;
+  int n;
+
+  VM_SWITCH() {
+
+    VM_CASE(OP_ADD): n = *ip++; sp -= n; VM_PUSH(lval_fold(SYM_ADD, sp, n)); VM_NEXT();
+    VM_CASE(OP_SUB): n = *ip++; sp -= n; VM_PUSH(lval_fold(SYM_SUB, sp, n)); VM_NEXT();
+    VM_CASE(OP_MUL): n = *ip++; sp -= n; VM_PUSH(lval_fold(SYM_MUL, sp, n)); VM_NEXT();
+    VM_CASE(OP_DIV): n = *ip++; sp -= n; VM_PUSH(lval_fold(SYM_DIV, sp, n)); VM_NEXT();
+    VM_CASE(OP_MOD): n = *ip++; sp -= n; VM_PUSH(lval_fold(SYM_MOD, sp, n)); VM_NEXT();
+
+    VM_CASE(OP_CONST): VM_PUSH(c->consts[*ip++]); VM_NEXT();
+    VM_CASE(OP_QUOTE): *sp++ = lval_copy(&region, c->consts[*ip++]); VM_NEXT();
+
+    VM_CASE(OP_CALL): {
+      int id = *ip++;
+      n = *ip++;
+      sp -= n;
+
+      // Builtins take their arguments as an S-Expression
+      lval* a = lval_reserve(lval_sexpr(), n);
+      memcpy(a->cell, sp, sizeof(lval*) * n);
+      a->count = n;
+      VM_PUSH(builtins[id](a));
+    }
+    VM_NEXT();
+
+    VM_CASE(OP_APPLY): {
+      n = *ip++;
+      sp -= n;
+
+      lval* a = lval_reserve(lval_sexpr(), n);
+      memcpy(a->cell, sp, sizeof(lval*) * n);
+      a->count = n;
+      VM_PUSH(lval_apply(a));
+    }
+    VM_NEXT();
+
+    VM_CASE(OP_RET): return sp[-1];
+  }
+
+  return lval_err("Bad bytecode!");
+}
+
+#undef VM_SWITCH
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_PUSH
+
 lval* lval_read_num(mpc_ast_t* t) {
-  errno = 0;
-  long x = strtol(t->contents, NULL, 10);
-  return errno != ERANGE ?
-    lval_num(x) : lval_err("invailid number!");
+  return lval_num_read(t->contents, strlen(t->contents));
 }
 
+/* Tag bits for the grammar, looked up once it is built so reading tests bits instead of strings */
+static unsigned long tag_number, tag_symbol, tag_sexpr, tag_qexpr, tag_regex, tag_root;
+
 lval* lval_read(mpc_ast_t* t) {
 
   /* If Symbol or a Number, returns a conversion to that type */
-  if (strstr(t->tag, "number")) { return lval_read_num(t); }
-  if (strstr(t->tag, "symbol")) { return lval_sym(t->contents); }
+  if (t->tags & tag_number) { return lval_read_num(t); }
+  if (t->tags & tag_symbol) { return lval_sym(t->contents); }
 
   /* If the root is '>' or sexpr then creates empty list */
   lval* x = NULL;
-  if (strcmp(t->tag, ">") == 0) { x = lval_sexpr(); }
-  if (strcmp(t->tag, "sexpr"))  { x = lval_sexpr(); }
+  if (t->tags == tag_root) { x = lval_sexpr(); }
+  if (t->tags & tag_sexpr) { x = lval_sexpr(); }
 
   // Q-Expressions
-  if (strstr(t->tag, "qexpr"))  { x = lval_qexpr(); }
+  if (t->tags & tag_qexpr)  { x = lval_qexpr(); }
   
   /* Fill the list with any valid expression passed through */
   for (int i = 0; i < t->children_num; i++) {
@@ -359,7 +1445,7 @@ lval* lval_read(mpc_ast_t* t) {
     if (strcmp(t->children[i]->contents, ")") == 0) { continue; }
     if (strcmp(t->children[i]->contents, "}") == 0) { continue; }
     if (strcmp(t->children[i]->contents, "{") == 0) { continue; }
-    if (strcmp(t->children[i]->tag,  "regex") == 0) { continue; }
+    if (t->children[i]->tags == tag_regex) { continue; }
 
     x = lval_add(x, lval_read(t->children[i]));
   }
@@ -367,8 +1453,681 @@ lval* lval_read(mpc_ast_t* t) {
   return x;
 }
 
+/*************************************************
+** Direct reader. Builds lvals straight from    **
+** the input in one pass, accepting the same    **
+** language as the grammar in main, but with no **
+** intermediate mpc_ast_t to build and delete.  **
+** A syntax error comes back as an Error lval,  **
+** which lval_eval passes through untouched.    **
+*************************************************/
+
+typedef struct {
+  const char* filename;
+  const char* start;
+  const char* pos;
+  const char* end;
+  // Line and column of start, for a read that begins partway into a file
+  long row, col;
+  // Set on a syntax error, which unwinds the whole read
+  lval* error;
+} lval_reader;
+
+static int lval_reader_space(char c) {
+  return c == ' ' || c == '\f' || c == '\n' || c == '\r' || c == '\t' || c == '\v';
+}
+
+static void lval_reader_skip(lval_reader* r) {
+  while (r->pos < r->end && lval_reader_space(*r->pos)) { r->pos++; }
+}
+
+/* Records a syntax error at the current position, worded like mpc's */
+static lval* lval_reader_fail(lval_reader* r, const char* expected) {
+  long row = r->row, col = r->col;
+  for (const char* c = r->start; c < r->pos; c++) {
+    if (*c == '\n') { row++; col = 1; } else { col++; }
+  }
+
+  char got[16];
+  if (r->pos == r->end) { strcpy(got, "end of input"); }
+  else { sprintf(got, "'%c'", *r->pos); }
+
+  char msg[512];
+  sprintf(msg, "%.256s:%li:%li: error: expected %s at %s",
+    r->filename, row, col, expected, got);
+  r->error = lval_err(msg);
+  return NULL;
+}
+
+lval* lval_read_expr(lval_reader* r);
+
+/* Reads expressions up to the close character, after its open one */
+static lval* lval_read_list(lval_reader* r, lval* x, char close) {
+  r->pos++;
+  lval_reader_skip(r);
+
+  while (r->pos < r->end && *r->pos != close) {
+    lval* y = lval_read_expr(r);
+    if (y == NULL) { return NULL; }
+    x = lval_add(x, y);
+  }
+
+  if (r->pos == r->end) {
+    return lval_reader_fail(r, close == ')' ?
+      "number, symbol, '(', '{' or ')'" : "number, symbol, '(', '{' or '}'");
+  }
+
+  r->pos++;
+  lval_reader_skip(r);
+  return x;
+}
+
+lval* lval_read_expr(lval_reader* r) {
+  const char* p = r->pos;
+  size_t left = r->end - p;
+
+  /* number : /-?[0-9]+/ is tried before any symbol, so "-5" is a number */
+  size_t n = (left > 0 && p[0] == '-') ? 1 : 0;
+  if (n < left && p[n] >= '0' && p[n] <= '9') {
+    while (n < left && p[n] >= '0' && p[n] <= '9') { n++; }
+    r->pos += n;
+    lval_reader_skip(r);
+    return lval_num_read(p, n);
+  }
+
+  /* symbol : the builtin names, matched as prefixes in grammar order */
+  for (int i = 0; i < SYM_BUILTINS; i++) {
+    size_t len = strlen(builtin_names[i]);
+    if (len <= left && memcmp(p, builtin_names[i], len) == 0) {
+      r->pos += len;
+      lval_reader_skip(r);
+      return lval_intern(p, len);
+    }
+  }
+
+  if (left > 0 && p[0] == '(') { return lval_read_list(r, lval_sexpr(), ')'); }
+  if (left > 0 && p[0] == '{') { return lval_read_list(r, lval_qexpr(), '}'); }
+
+  return lval_reader_fail(r, "number, symbol, '(' or '{'");
+}
+
+/* Reads every expression in the len bytes at s into one S-Expression */
+lval* lval_read_string(const char* filename, const char* s, size_t len) {
+  lval_reader r = { filename, s, s, s + len, 1, 1, NULL };
+  lval* x = lval_sexpr();
+
+  lval_reader_skip(&r);
+  while (r.pos < r.end) {
+    lval* y = lval_read_expr(&r);
+    if (y == NULL) { return r.error; }
+    x = lval_add(x, y);
+  }
+
+  return x;
+}
+
+/*************************************************
+** Batch mode. A file (or stdin, given as "-")  **
+** is read a block at a time, and each top-     **
+** level expression is evaluated and printed as **
+** soon as all of it is in, then freed. Memory  **
+** stays flat however long the input is; only   **
+** one very long expression grows the buffer.   **
+*************************************************/
+
+#define LVAL_STREAM_BLOCK (64 * 1024)
+
+/* Most threads --jobs will start */
+#define LVAL_JOBS_MAX 256
+
+/*
+ * Scans buf from *scan to len, keeping the bracket depth in *depth, and
+ * returns the last point where it can be cut between expressions, or 0.
+ * No token holds whitespace or a bracket, so at depth 0 a cut can go after
+ * whitespace or a closing bracket, and before an opening one.
+ */
+static size_t lval_stream_split(const char* buf, size_t len, size_t* scan, long* depth) {
+  size_t split = 0;
+
+  for (size_t i = *scan; i < len; i++) {
+    char c = buf[i];
+    if (c == '(' || c == '{') {
+      if (*depth == 0) { split = i; }
+      (*depth)++;
+    } else if (c == ')' || c == '}') {
+      if (*depth > 0) { (*depth)--; }
+      if (*depth == 0) { split = i + 1; }
+    } else if (*depth == 0 && lval_reader_space(c)) {
+      split = i + 1;
+    }
+  }
+
+  *scan = len;
+  return split;
+}
+
+/* Reads, evaluates and prints each expression in r in turn; 0 on a syntax error */
+static int lval_run_block(lval_reader* r) {
+  lval_reader_skip(r);
+  while (r->pos < r->end) {
+    lval* y = lval_read_expr(r);
+    if (y == NULL) {
+      fprintf(stderr, "%s\n", r->error->err);
+      lval_arena_reset(&region);
+      return 0;
+    }
+    lval_println(lval_eval(y));
+    lval_arena_reset(&region);
+  }
+  return 1;
+}
+
+#ifdef LVAL_JOBS
+
+/*************************************************
+** Parallel batch mode. Each block of input is  **
+** cut, between expressions, into jobs of about **
+** LVAL_JOB_SIZE bytes that a pool of threads   **
+** read and evaluate, each thread in a region   **
+** of its own. Reading only looks up builtins,  **
+** which are interned before any thread starts, **
+** and evaluating never interns, so the symbol  **
+** table is only read. A worker runs jobs from  **
+** the front of its share of the block and      **
+** steals the back half of another's once its   **
+** own are done. Results are printed into text  **
+** per worker and written out in input order.   **
+*************************************************/
+
+#define LVAL_JOB_SIZE 4096
+
+/* A slice of the block, and where its printed results went */
+typedef struct {
+  const char* from;
+  const char* to;
+  int worker;
+  size_t start;
+  size_t len;
+  // Length of the syntax error printed after the results, if any
+  size_t error;
+} lval_job;
+
+typedef struct lval_pool lval_pool;
+
+typedef struct {
+  lval_pool* pool;
+  pthread_t thread;
+  // Guards next and end, as other workers steal from the end
+  pthread_mutex_t lock;
+  // The jobs this worker has left
+  int next;
+  int end;
+  // Printed results of the jobs it ran
+  lval_text out;
+} lval_worker;
+
+struct lval_pool {
+  lval_worker* workers;
+  int count;
+  // The block being run, and the jobs it was cut into
+  lval_reader block;
+  lval_job* jobs;
+  int jobs_count;
+  int jobs_cap;
+  // Wakes the workers for each block, and the caller once all are done
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t finish;
+  int round;
+  int running;
+  int quit;
+};
+
+static int lval_worker_take(lval_worker* w) {
+  pthread_mutex_lock(&w->lock);
+  int i = w->next < w->end ? w->next++ : -1;
+  pthread_mutex_unlock(&w->lock);
+  return i;
+}
+
+/* Takes the back half of the next worker with jobs left, returning the first to run now */
+static int lval_worker_steal(lval_worker* w) {
+  lval_pool* p = w->pool;
+  int self = w - p->workers;
+
+  for (int k = 1; k < p->count; k++) {
+    lval_worker* v = &p->workers[(self + k) % p->count];
+
+    pthread_mutex_lock(&v->lock);
+    int end = v->end;
+    int from = end - (end - v->next + 1) / 2;
+    if (from < end) { v->end = from; }
+    pthread_mutex_unlock(&v->lock);
+
+    if (from < end) {
+      pthread_mutex_lock(&w->lock);
+      w->next = from + 1;
+      w->end = end;
+      pthread_mutex_unlock(&w->lock);
+      return from;
+    }
+  }
+
+  return -1;
+}
+
+/* Reads, evaluates and prints each expression of a job, as lval_run_block does */
+static void lval_worker_job(lval_worker* w, lval_job* j) {
+  lval_pool* p = w->pool;
+
+  /* Starting from the block's start keeps error positions right */
+  lval_reader r = p->block;
+  r.pos = j->from;
+  r.end = j->to;
+
+  j->worker = w - p->workers;
+  j->start = w->out.len;
+
+  lval_reader_skip(&r);
+  while (r.pos < r.end) {
+    lval* y = lval_read_expr(&r);
+    if (y == NULL) { break; }
+    lval_println(lval_eval(y));
+    lval_arena_reset(&region);
+  }
+
+  j->len = w->out.len - j->start;
+  if (r.error) { lval_write_str(r.error->err); }
+  j->error = w->out.len - j->start - j->len;
+  lval_arena_reset(&region);
+}
+
+static void lval_worker_run(lval_worker* w) {
+  int i;
+  output = &w->out;
+  while ((i = lval_worker_take(w)) >= 0 || (i = lval_worker_steal(w)) >= 0) {
+    lval_worker_job(w, &w->pool->jobs[i]);
+  }
+  output = NULL;
+}
+
+static void* lval_worker_main(void* arg) {
+  lval_worker* w = arg;
+  lval_pool* p = w->pool;
+  int round = 0;
+
+  pthread_mutex_lock(&p->lock);
+  while (1) {
+    while (p->round == round && !p->quit) { pthread_cond_wait(&p->start, &p->lock); }
+    if (p->quit) { break; }
+    round = p->round;
+    pthread_mutex_unlock(&p->lock);
+
+    lval_worker_run(w);
+
+    pthread_mutex_lock(&p->lock);
+    if (--p->running == 0) { pthread_cond_signal(&p->finish); }
+  }
+  pthread_mutex_unlock(&p->lock);
+
+  /* Frees what this thread kept, mpc's parse stack included */
+  lval_arena_free(&region);
+  mpc_stack_cache_free();
+  return NULL;
+}
+
+/* Starts count - 1 threads; the calling thread is the first worker */
+static lval_pool* lval_pool_new(int count) {
+  lval_pool* p = calloc(1, sizeof(lval_pool));
+  p->workers = calloc(count, sizeof(lval_worker));
+  p->count = 1;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->start, NULL);
+  pthread_cond_init(&p->finish, NULL);
+
+  for (int i = 0; i < count; i++) {
+    lval_worker* w = &p->workers[i];
+    w->pool = p;
+    pthread_mutex_init(&w->lock, NULL);
+    if (i == 0) { continue; }
+
+    /* Runs with however many threads could be started */
+    if (pthread_create(&w->thread, NULL, lval_worker_main, w) != 0) { break; }
+    p->count++;
+  }
+
+  return p;
+}
+
+static void lval_pool_delete(lval_pool* p) {
+  pthread_mutex_lock(&p->lock);
+  p->quit = 1;
+  pthread_cond_broadcast(&p->start);
+  pthread_mutex_unlock(&p->lock);
+
+  for (int i = 0; i < p->count; i++) {
+    if (i > 0) { pthread_join(p->workers[i].thread, NULL); }
+    pthread_mutex_destroy(&p->workers[i].lock);
+    free(p->workers[i].out.data);
+  }
+
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->start);
+  pthread_cond_destroy(&p->finish);
+  free(p->workers);
+  free(p->jobs);
+  free(p);
+}
+
+static void lval_pool_add(lval_pool* p, const char* from, const char* to) {
+  if (p->jobs_count == p->jobs_cap) {
+    p->jobs_cap = p->jobs_cap ? p->jobs_cap * 2 : 64;
+    p->jobs = realloc(p->jobs, sizeof(lval_job) * p->jobs_cap);
+  }
+  p->jobs[p->jobs_count].from = from;
+  p->jobs[p->jobs_count].to = to;
+  p->jobs_count++;
+}
+
+/* Runs every job on the pool, the calling thread included */
+static void lval_pool_run(lval_pool* p) {
+  int n = p->jobs_count;
+
+  /* All the workers are idle here, so their shares can be set without locks */
+  for (int k = 0; k < p->count; k++) {
+    p->workers[k].next = (int)((long)n * k / p->count);
+    p->workers[k].end = (int)((long)n * (k + 1) / p->count);
+    p->workers[k].out.len = 0;
+  }
+
+  pthread_mutex_lock(&p->lock);
+  p->running = p->count - 1;
+  p->round++;
+  pthread_cond_broadcast(&p->start);
+  pthread_mutex_unlock(&p->lock);
+
+  lval_worker_run(&p->workers[0]);
+
+  pthread_mutex_lock(&p->lock);
+  while (p->running > 0) { pthread_cond_wait(&p->finish, &p->lock); }
+  pthread_mutex_unlock(&p->lock);
+}
+
+/* Finds the split as lval_stream_split does, cutting what comes before it into jobs */
+static size_t lval_pool_split(lval_pool* p, const char* buf, size_t len, int done, size_t* scan, long* depth) {
+  size_t from = 0;
+
+  while (*scan < len) {
+    size_t limit = *scan + LVAL_JOB_SIZE < len ? *scan + LVAL_JOB_SIZE : len;
+    size_t cut = lval_stream_split(buf, limit, scan, depth);
+    if (cut > from) {
+      lval_pool_add(p, buf + from, buf + cut);
+      from = cut;
+    }
+  }
+
+  if (done && from < len) {
+    lval_pool_add(p, buf + from, buf + len);
+    from = len;
+  }
+
+  return from;
+}
+
+/* Runs the jobs of the block in r on the pool and writes out the results; 0 on a syntax error */
+static int lval_pool_block(lval_pool* p, lval_reader* r) {
+  p->block = *r;
+  lval_pool_run(p);
+
+  /* Jobs after a syntax error were run too, but as in order, nothing past it is printed */
+  int ok = 1;
+  for (int i = 0; i < p->jobs_count && ok; i++) {
+    lval_job* j = &p->jobs[i];
+    if (j->len + j->error == 0) { continue; }
+
+    char* out = p->workers[j->worker].out.data + j->start;
+    fwrite(out, 1, j->len, stdout);
+    if (j->error) {
+      fprintf(stderr, "%.*s\n", (int)j->error, out + j->len);
+      ok = 0;
+    }
+  }
+
+  p->jobs_count = 0;
+  return ok;
+}
+
+#endif
+
+int lval_run_file(const char* filename, int jobs) {
+  FILE* f = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "junior: cannot open %s\n", filename);
+    return 1;
+  }
+
+  /* Each worker gets a block's worth of input at a time */
+  size_t cap = LVAL_STREAM_BLOCK * jobs, len = 0, scan = 0;
+  char* buf = malloc(cap);
+  long depth = 0, row = 1, col = 1;
+  int status = 0, done = 0;
+
+#ifdef LVAL_JOBS
+  lval_pool* pool = jobs > 1 ? lval_pool_new(jobs) : NULL;
+#endif
+
+  /* Results go out in large writes rather than a line at a time */
+  setvbuf(stdout, NULL, _IOFBF, 64 * 1024);
+
+  while (!done && status == 0) {
+
+    /* Read a block, growing the buffer only when an expression fills most of it */
+    if (cap - len < LVAL_STREAM_BLOCK / 2) {
+      cap *= 2;
+      buf = realloc(buf, cap);
+    }
+    size_t n = fread(buf + len, 1, cap - len - 1, f);
+    done = n < cap - len - 1;
+    len += n;
+
+    /* Ends the block like the strings the REPL reads, so the reader sees the same input */
+    buf[len] = '\0';
+
+    if (ferror(f)) {
+      fprintf(stderr, "junior: cannot read %s\n", filename);
+      status = 1;
+      break;
+    }
+
+    /* At the end of input whatever is left is read, complete or not */
+    lval_reader r = { filename, buf, buf, buf, row, col, NULL };
+    size_t split;
+    int ok;
+
+#ifdef LVAL_JOBS
+    if (pool) {
+      split = lval_pool_split(pool, buf, len, done, &scan, &depth);
+      r.end = buf + split;
+      ok = lval_pool_block(pool, &r);
+    } else
+#endif
+    {
+      split = done ? len : lval_stream_split(buf, len, &scan, &depth);
+      r.end = buf + split;
+      ok = lval_run_block(&r);
+    }
+    if (!ok) { status = 1; }
+
+    /* Move what is left to the front, keeping count of lines for errors */
+    const char* line = NULL;
+    for (const char* c = buf; (c = memchr(c, '\n', buf + split - c)) != NULL; c++) {
+      row++;
+      line = c;
+    }
+    col = line ? (buf + split) - line : col + (long)split;
+    memmove(buf, buf + split, len - split);
+    len -= split;
+    scan -= split;
+  }
+
+  fflush(stdout);
+#ifdef LVAL_JOBS
+  if (pool) { lval_pool_delete(pool); }
+#endif
+  if (f != stdin) { fclose(f); }
+  free(buf);
+  return status;
+}
+
+/*************************************************
+** Bytecode benchmark. --bench-vm N file reads  **
+** each expression of a file once, compiles it, **
+** then evaluates it N times with the tree      **
+** walker and N times from the one chunk. Both  **
+** must print the same, and each result is      **
+** printed once; the time each evaluator took   **
+** goes to stderr at the end.                   **
+*************************************************/
+
+int lval_bench_file(const char* filename, int runs) {
+  FILE* f = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "junior: cannot open %s\n", filename);
+    return 1;
+  }
+
+  /* The whole file is read up front, so only evaluation is timed */
+  size_t cap = LVAL_STREAM_BLOCK, len = 0, n;
+  char* buf = malloc(cap);
+  while ((n = fread(buf + len, 1, cap - len, f)) > 0) {
+    len += n;
+    if (len == cap) { cap *= 2; buf = realloc(buf, cap); }
+  }
+  if (f != stdin) { fclose(f); }
+
+  /* Each expression and its chunk live here, outside the region every run resets */
+  lval_arena code = { NULL, NULL };
+  lval_text walked = { NULL, 0, 0 };
+  lval_text ran = { NULL, 0, 0 };
+  clock_t tree = 0, vm = 0;
+  long count = 0;
+  int status = 0;
+
+  lval_reader r = { filename, buf, buf, buf + len, 1, 1, NULL };
+  lval_reader_skip(&r);
+
+  while (r.pos < r.end) {
+    lval* y = lval_read_expr(&r);
+    if (y == NULL) {
+      fprintf(stderr, "%s\n", r.error->err);
+      status = 1;
+      break;
+    }
+    lval* x = lval_copy(&code, y);
+    lval_chunk* c = lval_compile(&code, x);
+    lval_arena_reset(&region);
+    walked.len = ran.len = 0;
+
+    /* Evaluating consumes the tree, so the walker gets a fresh copy each run */
+    clock_t t = clock();
+    output = &walked;
+    for (int i = 0; i < runs; i++) {
+      lval_println(lval_eval(lval_copy(&region, x)));
+      lval_arena_reset(&region);
+    }
+    tree += clock() - t;
+
+    t = clock();
+    output = &ran;
+    for (int i = 0; i < runs; i++) {
+      lval_println(lval_run(c));
+      lval_arena_reset(&region);
+    }
+    vm += clock() - t;
+    output = NULL;
+
+    count++;
+    if (walked.len != ran.len || memcmp(walked.data, ran.data, ran.len) != 0) {
+      fprintf(stderr, "junior: %s: expression %li evaluates differently as bytecode\n",
+        filename, count);
+      status = 1;
+      break;
+    }
+    fwrite(walked.data, 1, walked.len / runs, stdout);
+    lval_arena_reset(&code);
+  }
+
+  fprintf(stderr, "%li expressions, %d runs each: tree walker %.3fs, bytecode %.3fs\n",
+    count, runs, (double)tree / CLOCKS_PER_SEC, (double)vm / CLOCKS_PER_SEC);
+
+  lval_arena_free(&code);
+  free(walked.data);
+  free(ran.data);
+  free(buf);
+  return status;
+}
+
+int lval_usage(void) {
+  fputs("usage: junior [--mpc]\n"
+        "       junior [--jobs N] file.jr|-\n"
+        "       junior --bench-vm N file.jr|-\n", stderr);
+  return 1;
+}
+
+/* A count given to an option: a whole number of at least 1, else 0 */
+long lval_count_arg(const char* s) {
+  char* end;
+  errno = 0;
+  long n = strtol(s, &end, 10);
+  if (end == s || *end != '\0' || errno == ERANGE || n < 1) { return 0; }
+  return n;
+}
+
 int main(int argc, char** argv) {
 
+  /* Options come first; a file, or - for stdin, is run instead of starting the prompt */
+  long jobs = 0, runs = 0;
+  int use_mpc = 0;
+  const char* file = NULL;
+  for (int k = 1; k < argc; k++) {
+    if (strcmp(argv[k], "--jobs") == 0) {
+      jobs = k + 1 < argc ? lval_count_arg(argv[++k]) : 0;
+      if (jobs == 0) { return lval_usage(); }
+      if (jobs > LVAL_JOBS_MAX) { jobs = LVAL_JOBS_MAX; }
+    } else if (strcmp(argv[k], "--bench-vm") == 0) {
+      runs = k + 1 < argc ? lval_count_arg(argv[++k]) : 0;
+      if (runs == 0) { return lval_usage(); }
+    } else if (strcmp(argv[k], "--mpc") == 0) {
+      use_mpc = 1;
+    } else if (file == NULL && (argv[k][0] != '-' || argv[k][1] == '\0')) {
+      file = argv[k];
+    } else {
+      return lval_usage();
+    }
+  }
+
+  /* --mpc is for the prompt only; --jobs and --bench-vm each need a file, and not each other */
+  if (use_mpc ? (file != NULL || jobs || runs) : ((jobs || runs) && file == NULL) || (jobs && runs)) {
+    return lval_usage();
+  }
+
+  lval_intern_builtins();
+
+  /* --bench-vm N times the tree walker against the bytecode VM on a file */
+  if (runs > 0) {
+    int status = lval_bench_file(file, (int)runs);
+    lval_arena_free(&region);
+    lval_symtab_free();
+    return status;
+  }
+
+  if (file != NULL) {
+    int status = lval_run_file(file, jobs ? (int)jobs : 1);
+    lval_arena_free(&region);
+    lval_symtab_free();
+    return status;
+  }
+
   /* Create Parsers */
   mpc_parser_t* Number      = mpc_new("number");
   mpc_parser_t* Symbol      = mpc_new("symbol");
@@ -386,11 +2145,25 @@ int main(int argc, char** argv) {
                    '*' | '/' | '%' ;                \
       sexpr      : '(' <expression>* ')' ;          \
       qexpr      : '{' <expression>* '}' ;          \
-      expression : <number> | <symbol> | <sexpr> ;  \
+      expression : <number> | <symbol> | <sexpr>   \
+                 | <qexpr> ;                        \
       junior     : /^/ <expression>* /$/ ;          \
     ",
     Number, Symbol, Sexpr, Qexpr, Expression, Junior);
 
+  tag_number = mpc_tag_flag("number");
+  tag_symbol = mpc_tag_flag("symbol");
+  tag_sexpr  = mpc_tag_flag("sexpr");
+  tag_qexpr  = mpc_tag_flag("qexpr");
+  tag_regex  = mpc_tag_flag("regex");
+  tag_root   = mpc_tag_flag(">");
+
+  /* The grammar never changes from here on */
+  mpc_freeze(Junior);
+
+  /* One parse context, reused for every line; its trees live until the next parse */
+  mpc_context_t* context = mpc_context_new(MPC_CONTEXT_POOL_AST);
+
   puts("\n\tJunior- Version 0.0.1\nDeveloped by Noah Altunian (github.com/naltun/)\n");
   puts("Press ctrl+C to Exit\n");
 
@@ -400,16 +2173,31 @@ int main(int argc, char** argv) {
 
     add_history(input);
 
+    if (!use_mpc) {
+
+      /* Read straight into the region, then evaluate, print and release it */
+      lval* x = lval_read_string("<stdin>", input, strlen(input));
+
+      /* A syntax error is printed bare, as mpc_err_print prints one */
+      if (lval_type(x) == LVAL_ERR) {
+        printf("%s\n", x->err);
+      } else {
+        lval_println(lval_eval(x));
+      }
+      lval_arena_reset(&region);
+      free(input);
+      continue;
+    }
+
     /* Parse user input */
     mpc_result_t r;
 
-    if (mpc_parse("<stdin>", input, Junior, &r)) {
+    if (mpc_context_parse(context, "<stdin>", input, Junior, &r)) {
 
-      /* If evaluation is successful, print result and delete the output regex tree */
+      /* If evaluation is successful, print result, then release the region; the tree goes with the next parse */
       lval* x = lval_eval(lval_read(r.output));
       lval_println(x);
-      lval_del(x);
-      mpc_ast_delete(r.output);
+      lval_arena_reset(&region);
     } else {
 
       /* If not successful, print and delete error  */
@@ -420,6 +2208,9 @@ int main(int argc, char** argv) {
     free(input);
   }
 
+  lval_arena_free(&region);
+  lval_symtab_free();
+  mpc_context_delete(context);
   mpc_cleanup(6, Number, Symbol, Sexpr, Qexpr, Expression, Junior);
 
   return 0;
@@ -1,5 +1,39 @@
+/*
+** Files are mapped only where the build already
+** exposes POSIX (e.g. gnu99). A strict ANSI/ISO
+** build hides fileno and mmap, so it keeps the
+** plain FILE input.
+*/
+
+#if (defined(__unix__) || defined(__APPLE__)) && \
+    (!defined(__STRICT_ANSI__) || defined(_POSIX_C_SOURCE))
+#define MPC_USE_MMAP
+#endif
+
 #include "mpc.h"
 
+#include <limits.h>
+
+#ifdef MPC_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+** Without thread-local storage there is no stack
+** cache: each parse gets a stack of its own.
+*/
+
+#if defined(_MSC_VER)
+#define MPC_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define MPC_THREAD_LOCAL __thread
+#else
+#define MPC_THREAD_LOCAL
+#define MPC_NO_THREAD_LOCAL
+#endif
+
 /*
 ** State Type
 */
@@ -60,6 +94,8 @@ static mpc_err_t *mpc_err_fail(const char *filename, mpc_state_t s, const char *
 void mpc_err_delete(mpc_err_t *x) {
 
   int i;
+  if (x == NULL) { return; }
+  
   for (i = 0; i < x->expected_num; i++) {
     free(x->expected[i]);
   }
@@ -70,6 +106,31 @@ void mpc_err_delete(mpc_err_t *x) {
   free(x);
 }
 
+static mpc_err_t *mpc_err_copy(mpc_err_t *x) {
+  
+  int i;
+  mpc_err_t *e;
+  if (x == NULL) { return NULL; }
+  
+  e = malloc(sizeof(mpc_err_t));
+  e->filename = malloc(strlen(x->filename) + 1);
+  strcpy(e->filename, x->filename);
+  e->state = x->state;
+  e->expected_num = x->expected_num;
+  e->expected = malloc(sizeof(char*) * x->expected_num);
+  for (i = 0; i < x->expected_num; i++) {
+    e->expected[i] = malloc(strlen(x->expected[i]) + 1);
+    strcpy(e->expected[i], x->expected[i]);
+  }
+  e->failure = NULL;
+  if (x->failure) {
+    e->failure = malloc(strlen(x->failure) + 1);
+    strcpy(e->failure, x->failure);
+  }
+  e->recieved = x->recieved;
+  return e;
+}
+
 static int mpc_err_contains_expected(mpc_err_t *x, char *expected) {
   
   int i;
@@ -122,14 +183,13 @@ void mpc_err_string_cat(char *buffer, int *pos, int *max, char const *fmt, ...)
   va_end(va);
 }
 
-static char char_unescape_buffer[4];
-
-static const char *mpc_err_char_unescape(char c) {
+/* Any character not named is quoted in buffer, which has room for 4 */
+static const char *mpc_err_char_unescape(char c, char *buffer) {
   
-  char_unescape_buffer[0] = '\'';
-  char_unescape_buffer[1] = ' ';
-  char_unescape_buffer[2] = '\'';
-  char_unescape_buffer[3] = '\0';
+  buffer[0] = '\'';
+  buffer[1] = ' ';
+  buffer[2] = '\'';
+  buffer[3] = '\0';
   
   switch (c) {
     
@@ -143,8 +203,8 @@ static const char *mpc_err_char_unescape(char c) {
     case '\t': return "tab";
     case ' ' : return "space";
     default:
-      char_unescape_buffer[1] = c;
-      return char_unescape_buffer;
+      buffer[1] = c;
+      return buffer;
   }
   
 }
@@ -155,6 +215,7 @@ char *mpc_err_string(mpc_err_t *x) {
   int pos = 0; 
   int max = 1023;
   char *buffer = calloc(1, 1024);
+  char unescaped[4];
   
   if (x->failure) {
     mpc_err_string_cat(buffer, &pos, &max,
@@ -179,7 +240,7 @@ char *mpc_err_string(mpc_err_t *x) {
   }
   
   mpc_err_string_cat(buffer, &pos, &max, " at ");
-  mpc_err_string_cat(buffer, &pos, &max, mpc_err_char_unescape(x->recieved));
+  mpc_err_string_cat(buffer, &pos, &max, "%s", mpc_err_char_unescape(x->recieved, unescaped));
   mpc_err_string_cat(buffer, &pos, &max, "\n");
   
   return realloc(buffer, strlen(buffer) + 1);
@@ -188,7 +249,12 @@ char *mpc_err_string(mpc_err_t *x) {
 static mpc_err_t *mpc_err_or(mpc_err_t** x, int n) {
   
   int i, j;
-  mpc_err_t *e = malloc(sizeof(mpc_err_t));
+  mpc_err_t *e;
+  
+  /* In a quiet parse every error is NULL */
+  if (x[0] == NULL) { return NULL; }
+  
+  e = malloc(sizeof(mpc_err_t));
   e->state = mpc_state_invalid();
   e->expected_num = 0;
   e->expected = NULL;
@@ -227,7 +293,10 @@ static mpc_err_t *mpc_err_or(mpc_err_t** x, int n) {
 static mpc_err_t *mpc_err_repeat(mpc_err_t *x, const char *prefix) {
 
   int i;
-  char *expect = malloc(strlen(prefix) + 1);
+  char *expect;
+  if (x == NULL) { return NULL; }
+  
+  expect = malloc(strlen(prefix) + 1);
   strcpy(expect, prefix);
   
   if (x->expected_num == 1) {
@@ -265,7 +334,10 @@ static mpc_err_t *mpc_err_many1(mpc_err_t *x) {
 static mpc_err_t *mpc_err_count(mpc_err_t *x, int n) {
   mpc_err_t *y;
   int digits = n/10 + 1;
-  char *prefix = malloc(digits + strlen(" of ") + 1);
+  char *prefix;
+  if (x == NULL) { return NULL; }
+  
+  prefix = malloc(digits + strlen(" of ") + 1);
   sprintf(prefix, "%i of ", n);
   y = mpc_err_repeat(x, prefix);
   free(prefix);
@@ -305,34 +377,101 @@ static mpc_err_t *mpc_err_count(mpc_err_t *x, int n) {
 ** backtracking and make LL(1) grammars easy
 ** to parse for all input methods.
 **
+** Where the platform allows, a seekable file is
+** instead mapped into memory and read just like
+** a string, so that neither lookahead nor
+** rewinding touches stdio. Streams which cannot
+** be mapped fall back to the file input.
+**
+** String input is borrowed rather than copied:
+** the caller's string must stay alive for the
+** parse, and its length is taken only once.
+**
 */
 
+/* Pipe buffer capacity kept between backtracking windows */
+#define MPC_INPUT_PIPE_KEEP 256
+
+/* Initial room for marks, which then double as needed */
+#define MPC_INPUT_MARKS_MIN 32
+
 enum {
   MPC_INPUT_STRING = 0,
   MPC_INPUT_FILE   = 1,
-  MPC_INPUT_PIPE   = 2
+  MPC_INPUT_PIPE   = 2,
+  MPC_INPUT_MMAP   = 3
 };
 
+/*
+** Packrat Memo
+**
+** Results of `mpc_memo` parsers are remembered
+** per start position, so that backtracking into
+** the same rule at the same place is answered
+** from the table instead of parsed again.
+**
+** To keep memory bounded the table is a sliding
+** window: position `pos` lives in row
+** `pos % MPC_MEMO_WINDOW`, and a row is cleared
+** whenever a different position claims it.
+** Successful results are copied into the table,
+** so results spanning more than the window are
+** not kept. As long as no backtrack reaches
+** further back than the window, parsing stays
+** linear.
+*/
+
+#define MPC_MEMO_WINDOW 4096
+
+typedef struct {
+  mpc_parser_t *p;
+  int success;
+  mpc_state_t state;
+  char last;
+  mpc_result_t r;
+  mpc_dtor_t dx;
+} mpc_memo_t;
+
+typedef struct {
+  long pos;
+  int memos_num;
+  int memos_slots;
+  mpc_memo_t *memos;
+} mpc_memo_row_t;
+
 typedef struct {
 
   int type;
   char *filename;  
   mpc_state_t state;
   
-  char *string;
+  const char *string;
   char *buffer;
+  long buffer_len;
+  long buffer_cap;
   FILE *file;
   
+  long length;
+  void *map;
+  size_t map_size;
+  long offset;
+  
   int backtrack;
   int marks_num;
+  int marks_slots;
   mpc_state_t* marks;
   char* lasts;
   
   char last;
   
+  mpc_memo_row_t *memo;
+  
+  int quiet;
+  int dry;
+  
 } mpc_input_t;
 
-static mpc_input_t *mpc_input_new_string(const char *filename, const char *string) {
+static mpc_input_t *mpc_input_new_nstring(const char *filename, const char *string, long length) {
 
   mpc_input_t *i = malloc(sizeof(mpc_input_t));
   
@@ -342,21 +481,35 @@ static mpc_input_t *mpc_input_new_string(const char *filename, const char *strin
   
   i->state = mpc_state_new();
   
-  i->string = malloc(strlen(string) + 1);
-  strcpy(i->string, string);
+  i->string = string;
   i->buffer = NULL;
+  i->buffer_len = 0;
+  i->buffer_cap = 0;
   i->file = NULL;
   
+  i->length = length;
+  i->map = NULL;
+  i->map_size = 0;
+  i->offset = 0;
+  
   i->backtrack = 1;
   i->marks_num = 0;
+  i->marks_slots = 0;
   i->marks = NULL;
   i->lasts = NULL;
+  i->memo = NULL;
+  i->quiet = 0;
+  i->dry = 0;
 
   i->last = '\0';
   
   return i;
 }
 
+static mpc_input_t *mpc_input_new_string(const char *filename, const char *string) {
+  return mpc_input_new_nstring(filename, string, (long)strlen(string));
+}
+
 static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
 
   mpc_input_t *i = malloc(sizeof(mpc_input_t));
@@ -369,12 +522,23 @@ static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
   
   i->string = NULL;
   i->buffer = NULL;
+  i->buffer_len = 0;
+  i->buffer_cap = 0;
   i->file = pipe;
   
+  i->length = 0;
+  i->map = NULL;
+  i->map_size = 0;
+  i->offset = 0;
+  
   i->backtrack = 1;
   i->marks_num = 0;
+  i->marks_slots = 0;
   i->marks = NULL;
   i->lasts = NULL;
+  i->memo = NULL;
+  i->quiet = 0;
+  i->dry = 0;
   
   i->last = '\0';
   
@@ -393,30 +557,128 @@ static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
   
   i->string = NULL;
   i->buffer = NULL;
+  i->buffer_len = 0;
+  i->buffer_cap = 0;
   i->file = file;
   
+  i->length = 0;
+  i->map = NULL;
+  i->map_size = 0;
+  i->offset = 0;
+  
   i->backtrack = 1;
   i->marks_num = 0;
+  i->marks_slots = 0;
   i->marks = NULL;
   i->lasts = NULL;
+  i->memo = NULL;
+  i->quiet = 0;
+  i->dry = 0;
   
   i->last = '\0';
   
   return i;
 }
 
+/*
+** Maps the rest of a regular file, from its current
+** position, returning NULL if it cannot be mapped.
+*/
+
+static mpc_input_t *mpc_input_new_mmap(const char *filename, FILE *file) {
+  
+#ifdef MPC_USE_MMAP
+  
+  mpc_input_t *i;
+  struct stat st;
+  void *map = NULL;
+  long offset = ftell(file);
+  
+  if (offset < 0) { return NULL; }
+  if (fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode)) { return NULL; }
+  if (st.st_size < offset) { return NULL; }
+  
+  if (st.st_size > 0) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (map == MAP_FAILED) { return NULL; }
+  }
+  
+  i = mpc_input_new_file(filename, file);
+  i->type = MPC_INPUT_MMAP;
+  i->map = map;
+  i->map_size = st.st_size;
+  i->offset = offset;
+  i->string = map ? (const char*)map + offset : "";
+  i->length = (long)st.st_size - offset;
+  
+  return i;
+  
+#else
+  (void)filename; (void)file;
+  return NULL;
+#endif
+  
+}
+
+static void mpc_input_memo_clear(mpc_memo_row_t *row) {
+  int j;
+  for (j = 0; j < row->memos_num; j++) {
+    if (row->memos[j].success) { row->memos[j].dx(row->memos[j].r.output); }
+    else { mpc_err_delete(row->memos[j].r.error); }
+  }
+  row->memos_num = 0;
+}
+
 static void mpc_input_delete(mpc_input_t *i) {
   
+  int j;
+  if (i->memo) {
+    for (j = 0; j < MPC_MEMO_WINDOW; j++) {
+      mpc_input_memo_clear(&i->memo[j]);
+      free(i->memo[j].memos);
+    }
+    free(i->memo);
+  }
+  
   free(i->filename);
   
-  if (i->type == MPC_INPUT_STRING) { free(i->string); }
   if (i->type == MPC_INPUT_PIPE) { free(i->buffer); }
   
+#ifdef MPC_USE_MMAP
+  if (i->type == MPC_INPUT_MMAP) {
+    /* Leave the stream just after the consumed input, as the file input does */
+    fseek(i->file, i->offset + i->state.pos, SEEK_SET);
+    if (i->map) { munmap(i->map, i->map_size); }
+  }
+#endif
+  
   free(i->marks);
   free(i->lasts);
   free(i);
 }
 
+/* Points a string input at new text, keeping what it has allocated */
+static void mpc_input_reset_nstring(mpc_input_t *i, const char *filename, const char *string, long length) {
+  
+  int j;
+  
+  if (strcmp(i->filename, filename) != 0) {
+    i->filename = realloc(i->filename, strlen(filename) + 1);
+    strcpy(i->filename, filename);
+  }
+  
+  i->state = mpc_state_new();
+  i->string = string;
+  i->length = length;
+  i->backtrack = 1;
+  i->marks_num = 0;
+  i->last = '\0';
+  
+  if (i->memo) {
+    for (j = 0; j < MPC_MEMO_WINDOW; j++) { mpc_input_memo_clear(&i->memo[j]); }
+  }
+}
+
 static void mpc_input_backtrack_disable(mpc_input_t *i) { i->backtrack--; }
 static void mpc_input_backtrack_enable(mpc_input_t *i) { i->backtrack++; }
 
@@ -425,13 +687,16 @@ static void mpc_input_mark(mpc_input_t *i) {
   if (i->backtrack < 1) { return; }
   
   i->marks_num++;
-  i->marks = realloc(i->marks, sizeof(mpc_state_t) * i->marks_num);
-  i->lasts = realloc(i->lasts, sizeof(char) * i->marks_num);
+  if (i->marks_num > i->marks_slots) {
+    i->marks_slots = i->marks_slots ? i->marks_slots * 2 : MPC_INPUT_MARKS_MIN;
+    i->marks = realloc(i->marks, sizeof(mpc_state_t) * i->marks_slots);
+    i->lasts = realloc(i->lasts, sizeof(char) * i->marks_slots);
+  }
   i->marks[i->marks_num-1] = i->state;
   i->lasts[i->marks_num-1] = i->last;
   
   if (i->type == MPC_INPUT_PIPE && i->marks_num == 1) {
-    i->buffer = calloc(1, 1);
+    i->buffer_len = 0;
   }
   
 }
@@ -441,12 +706,15 @@ static void mpc_input_unmark(mpc_input_t *i) {
   if (i->backtrack < 1) { return; }
   
   i->marks_num--;
-  i->marks = realloc(i->marks, sizeof(mpc_state_t) * i->marks_num);
-  i->lasts = realloc(i->lasts, sizeof(char) * i->marks_num);
   
+  /* Nothing can be rewound to any more; keep only a small buffer for reuse */
   if (i->type == MPC_INPUT_PIPE && i->marks_num == 0) {
-    free(i->buffer);
-    i->buffer = NULL;
+    i->buffer_len = 0;
+    if (i->buffer_cap > MPC_INPUT_PIPE_KEEP) {
+      free(i->buffer);
+      i->buffer = NULL;
+      i->buffer_cap = 0;
+    }
   }
   
 }
@@ -466,7 +734,15 @@ static void mpc_input_rewind(mpc_input_t *i) {
 }
 
 static int mpc_input_buffer_in_range(mpc_input_t *i) {
-  return i->state.pos < (long)(strlen(i->buffer) + i->marks[0].pos);
+  return i->state.pos < i->buffer_len + i->marks[0].pos;
+}
+
+static void mpc_input_buffer_push(mpc_input_t *i, char c) {
+  if (i->buffer_len == i->buffer_cap) {
+    i->buffer_cap = i->buffer_cap ? i->buffer_cap * 2 : MPC_INPUT_PIPE_KEEP;
+    i->buffer = realloc(i->buffer, i->buffer_cap);
+  }
+  i->buffer[i->buffer_len++] = c;
 }
 
 static char mpc_input_buffer_get(mpc_input_t *i) {
@@ -474,9 +750,10 @@ static char mpc_input_buffer_get(mpc_input_t *i) {
 }
 
 static int mpc_input_terminated(mpc_input_t *i) {
-  if (i->type == MPC_INPUT_STRING && i->state.pos == (long)strlen(i->string)) { return 1; }
+  if (i->type == MPC_INPUT_STRING && i->state.pos == i->length) { return 1; }
   if (i->type == MPC_INPUT_FILE && feof(i->file)) { return 1; }
   if (i->type == MPC_INPUT_PIPE && feof(i->file)) { return 1; }
+  if (i->type == MPC_INPUT_MMAP && i->state.pos == i->length) { return 1; }
   return 0;
 }
 
@@ -486,13 +763,14 @@ static char mpc_input_getc(mpc_input_t *i) {
   
   switch (i->type) {
     
-    case MPC_INPUT_STRING: return i->string[i->state.pos];
+    case MPC_INPUT_STRING:
+    case MPC_INPUT_MMAP: return i->state.pos < i->length ? i->string[i->state.pos] : '\0';
     case MPC_INPUT_FILE: c = fgetc(i->file); return c;
     case MPC_INPUT_PIPE:
     
-      if (!i->buffer) { c = getc(i->file); return c; }
+      if (i->marks_num == 0) { c = getc(i->file); return c; }
       
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
+      if (mpc_input_buffer_in_range(i)) {
         c = mpc_input_buffer_get(i);
         return c;
       } else {
@@ -509,7 +787,8 @@ static char mpc_input_peekc(mpc_input_t *i) {
   char c = '\0';
   
   switch (i->type) {
-    case MPC_INPUT_STRING: return i->string[i->state.pos];
+    case MPC_INPUT_STRING:
+    case MPC_INPUT_MMAP: return i->state.pos < i->length ? i->string[i->state.pos] : '\0';
     case MPC_INPUT_FILE: 
       
       c = fgetc(i->file);
@@ -520,14 +799,14 @@ static char mpc_input_peekc(mpc_input_t *i) {
     
     case MPC_INPUT_PIPE:
       
-      if (!i->buffer) {
+      if (i->marks_num == 0) {
         c = getc(i->file);
         if (feof(i->file)) { return '\0'; }
         ungetc(c, i->file);
         return c;
       }
       
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
+      if (mpc_input_buffer_in_range(i)) {
         return mpc_input_buffer_get(i);
       } else {
         c = getc(i->file);
@@ -548,9 +827,9 @@ static int mpc_input_failure(mpc_input_t *i, char c) {
     case MPC_INPUT_FILE: fseek(i->file, -1, SEEK_CUR); { break; }
     case MPC_INPUT_PIPE: {
       
-      if (!i->buffer) { ungetc(c, i->file); break; }
+      if (i->marks_num == 0) { ungetc(c, i->file); break; }
       
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
+      if (mpc_input_buffer_in_range(i)) {
         break;
       } else {
         ungetc(c, i->file); 
@@ -564,12 +843,9 @@ static int mpc_input_failure(mpc_input_t *i, char c) {
 static int mpc_input_success(mpc_input_t *i, char c, char **o) {
   
   if (i->type == MPC_INPUT_PIPE &&
-      i->buffer &&
+      i->marks_num > 0 &&
       !mpc_input_buffer_in_range(i)) {
-    
-    i->buffer = realloc(i->buffer, strlen(i->buffer) + 2);
-    i->buffer[strlen(i->buffer) + 1] = '\0';
-    i->buffer[strlen(i->buffer) + 0] = c;
+    mpc_input_buffer_push(i, c);
   }
   
   i->last = c;
@@ -620,6 +896,12 @@ static int mpc_input_noneof(mpc_input_t *i, const char *c, char **o) {
   return strchr(c, x) == 0 ? mpc_input_success(i, x, o) : mpc_input_failure(i, x);  
 }
 
+static int mpc_input_set(mpc_input_t *i, const unsigned char *set, char **o) {
+  unsigned char x = mpc_input_getc(i);
+  if (mpc_input_terminated(i)) { return 0; }
+  return (set[x >> 3] & (1 << (x & 7))) ? mpc_input_success(i, x, o) : mpc_input_failure(i, x);
+}
+
 static int mpc_input_satisfy(mpc_input_t *i, int(*cond)(char), char **o) {
   char x = mpc_input_getc(i);
   if (mpc_input_terminated(i)) { return 0; }
@@ -628,14 +910,11 @@ static int mpc_input_satisfy(mpc_input_t *i, int(*cond)(char), char **o) {
 
 static int mpc_input_string(mpc_input_t *i, const char *c, char **o) {
   
-  char *co = NULL;
   const char *x = c;
 
   mpc_input_mark(i);
   while (*x) {
-    if (mpc_input_char(i, *x, &co)) {
-      free(co);
-    } else {
+    if (!mpc_input_char(i, *x, NULL)) {
       mpc_input_rewind(i);
       return 0;
     }
@@ -652,6 +931,84 @@ static int mpc_input_anchor(mpc_input_t* i, int(*f)(char,char)) {
   return f(i->last, mpc_input_peekc(i));
 }
 
+/*
+** Errors at the current position. A quiet parse
+** builds none of them and uses NULL instead, as
+** the parse is run again if it fails.
+*/
+
+static mpc_err_t *mpc_input_err_new(mpc_input_t *i, const char *expected) {
+  return i->quiet ? NULL : mpc_err_new(i->filename, i->state, expected, mpc_input_peekc(i));
+}
+
+static mpc_err_t *mpc_input_err_fail(mpc_input_t *i, const char *failure) {
+  return i->quiet ? NULL : mpc_err_fail(i->filename, i->state, failure);
+}
+
+/*
+** A dry parse builds errors but no values, so no
+** user function is called. Every output is NULL.
+*/
+
+static mpc_val_t *mpc_input_out(mpc_input_t *i, char *s) {
+  if (i->dry) { free(s); return NULL; }
+  return s;
+}
+
+/*
+** Only inputs which can jump straight to any
+** position are memoised, and only while it is
+** possible to backtrack at all.
+*/
+
+static int mpc_input_memoable(mpc_input_t *i) {
+  return (i->type == MPC_INPUT_STRING || i->type == MPC_INPUT_MMAP) && i->backtrack > 0;
+}
+
+static mpc_memo_t *mpc_input_memo_find(mpc_input_t *i, mpc_parser_t *p) {
+  
+  int j;
+  mpc_memo_row_t *row;
+  
+  if (i->memo == NULL) { return NULL; }
+  
+  row = &i->memo[i->state.pos % MPC_MEMO_WINDOW];
+  if (row->pos != i->state.pos) { return NULL; }
+  
+  for (j = 0; j < row->memos_num; j++) {
+    if (row->memos[j].p == p) { return &row->memos[j]; }
+  }
+  
+  return NULL;
+}
+
+static void mpc_input_memo_add(mpc_input_t *i, mpc_parser_t *p, long pos, int success, mpc_result_t r, mpc_dtor_t dx) {
+  
+  mpc_memo_row_t *row;
+  mpc_memo_t *m;
+  
+  if (i->memo == NULL) { i->memo = calloc(MPC_MEMO_WINDOW, sizeof(mpc_memo_row_t)); }
+  
+  row = &i->memo[pos % MPC_MEMO_WINDOW];
+  if (row->pos != pos) {
+    mpc_input_memo_clear(row);
+    row->pos = pos;
+  }
+  
+  if (row->memos_num == row->memos_slots) {
+    row->memos_slots = row->memos_slots ? row->memos_slots * 2 : 4;
+    row->memos = realloc(row->memos, sizeof(mpc_memo_t) * row->memos_slots);
+  }
+  
+  m = &row->memos[row->memos_num++];
+  m->p = p;
+  m->success = success;
+  m->state = i->state;
+  m->last = i->last;
+  m->r = r;
+  m->dx = dx;
+}
+
 /*
 ** Parser Type
 */
@@ -684,7 +1041,11 @@ enum {
   MPC_TYPE_COUNT     = 22,
   
   MPC_TYPE_OR        = 23,
-  MPC_TYPE_AND       = 24
+  MPC_TYPE_AND       = 24,
+  
+  MPC_TYPE_MEMO      = 25,
+  
+  MPC_TYPE_RE        = 26
 };
 
 typedef struct { char *m; } mpc_pdata_fail_t;
@@ -700,8 +1061,22 @@ typedef struct { mpc_parser_t *x; mpc_apply_to_t f; void *d; } mpc_pdata_apply_t
 typedef struct { mpc_parser_t *x; } mpc_pdata_predict_t;
 typedef struct { mpc_parser_t *x; mpc_dtor_t dx; mpc_ctor_t lf; } mpc_pdata_not_t;
 typedef struct { int n; mpc_fold_t f; mpc_parser_t *x; mpc_dtor_t dx; } mpc_pdata_repeat_t;
-typedef struct { int n; mpc_parser_t **xs; } mpc_pdata_or_t;
+typedef struct { unsigned char set[32]; int nullable; } mpc_first_t;
+typedef struct { int n; mpc_parser_t **xs; mpc_first_t *first; unsigned long version; } mpc_pdata_or_t;
 typedef struct { int n; mpc_fold_t f; mpc_parser_t **xs; mpc_dtor_t *dxs;  } mpc_pdata_and_t;
+typedef struct { mpc_parser_t *x; mpc_apply_t cf; mpc_dtor_t dx; } mpc_pdata_memo_t;
+
+enum {
+  MPC_RE_ONE    = 0,
+  MPC_RE_MAYBE  = 1,
+  MPC_RE_MANY   = 2,
+  MPC_RE_MANY1  = 3,
+  MPC_RE_COUNT  = 4,
+  MPC_RE_ANCHOR = 5
+};
+
+typedef struct { int type; int n; unsigned char set[32]; char *m; int(*f)(char,char); } mpc_re_step_t;
+typedef struct { int n; mpc_re_step_t *xs; char *re; } mpc_pdata_re_t;
 
 typedef union {
   mpc_pdata_fail_t fail;
@@ -719,19 +1094,96 @@ typedef union {
   mpc_pdata_repeat_t repeat;
   mpc_pdata_and_t and;
   mpc_pdata_or_t or;
+  mpc_pdata_memo_t memo;
+  mpc_pdata_re_t re;
 } mpc_pdata_t;
 
 struct mpc_parser_t {
   char retained;
+  char frozen;
   char *name;
   char type;
+  unsigned long changed;
   mpc_pdata_t data;
 };
 
+/*
+** AST Pool
+**
+** A pool hands out memory for AST nodes, their
+** children and strings from large blocks, and is
+** emptied all at once. While a pooled context is
+** parsing, the pool is set for the thread so that
+** every AST function allocates from it.
+*/
+
+#define MPC_AST_POOL_BLOCK 16384
+
+typedef struct mpc_ast_block_t {
+  struct mpc_ast_block_t *next;
+  size_t size;
+  size_t used;
+} mpc_ast_block_t;
+
+typedef struct {
+  mpc_ast_block_t *first;
+  mpc_ast_block_t *curr;
+} mpc_ast_pool_t;
+
+static MPC_THREAD_LOCAL mpc_ast_pool_t *mpc_ast_pool = NULL;
+
+static void *mpc_ast_pool_alloc(mpc_ast_pool_t *p, size_t n) {
+  
+  size_t size;
+  mpc_ast_block_t *b = p->curr, *prev = NULL;
+  
+  n = (n + 7) & ~(size_t)7;
+  while (b && b->used + n > b->size) { prev = b; b = b->next; }
+  
+  if (b == NULL) {
+    size = n > MPC_AST_POOL_BLOCK ? n : MPC_AST_POOL_BLOCK;
+    b = malloc(sizeof(mpc_ast_block_t) + size);
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    if (prev) { prev->next = b; } else { p->first = b; }
+  }
+  
+  p->curr = b;
+  b->used += n;
+  return (char*)(b + 1) + b->used - n;
+}
+
+static void mpc_ast_pool_reset(mpc_ast_pool_t *p) {
+  mpc_ast_block_t *b;
+  for (b = p->first; b; b = b->next) { b->used = 0; }
+  p->curr = p->first;
+}
+
+static void mpc_ast_pool_free(mpc_ast_pool_t *p) {
+  mpc_ast_block_t *b = p->first, *next;
+  while (b) {
+    next = b->next;
+    free(b);
+    b = next;
+  }
+  p->first = NULL;
+  p->curr = NULL;
+}
+
 /*
 ** Stack Type
+**
+** Stacks only ever grow, doubling in size, and
+** once a parse is done its stack is kept for the
+** next parse on the same thread. A steady stream
+** of parses then allocates no stack at all. Very
+** deep stacks are freed rather than kept.
 */
 
+#define MPC_STACK_MIN 64
+#define MPC_STACK_KEEP 4096
+
 typedef struct {
 
   int parsers_num;
@@ -745,35 +1197,54 @@ typedef struct {
   int *returns;
   
   mpc_err_t *err;
+  int dry;
   
 } mpc_stack_t;
 
-static mpc_stack_t *mpc_stack_new(const char *filename) {
-  mpc_stack_t *s = malloc(sizeof(mpc_stack_t));
+static MPC_THREAD_LOCAL mpc_stack_t *mpc_stack_cache = NULL;
+
+static mpc_stack_t *mpc_stack_new(const char *filename, int quiet, mpc_stack_t **cache) {
   
-  s->parsers_num = 0;
-  s->parsers_slots = 0;
-  s->parsers = NULL;
-  s->states = NULL;
+  mpc_stack_t *s = *cache;
+  
+  /* A parse started from inside another parse gets a stack of its own */
+  if (s) {
+    *cache = NULL;
+  } else {
+    s = malloc(sizeof(mpc_stack_t));
+    s->parsers_slots = MPC_STACK_MIN;
+    s->parsers = malloc(sizeof(mpc_parser_t*) * s->parsers_slots);
+    s->states = malloc(sizeof(int) * s->parsers_slots);
+    s->results_slots = MPC_STACK_MIN;
+    s->results = malloc(sizeof(mpc_result_t) * s->results_slots);
+    s->returns = malloc(sizeof(int) * s->results_slots);
+  }
   
+  s->parsers_num = 0;
   s->results_num = 0;
-  s->results_slots = 0;
-  s->results = NULL;
-  s->returns = NULL;
   
-  s->err = mpc_err_fail(filename, mpc_state_invalid(), "Unknown Error");
+  s->err = quiet ? NULL : mpc_err_fail(filename, mpc_state_invalid(), "Unknown Error");
   
   return s;
 }
 
 static void mpc_stack_err(mpc_stack_t *s, mpc_err_t* e) {
   mpc_err_t *errs[2];
+  if (e == NULL) { return; }
   errs[0] = s->err;
   errs[1] = e;
   s->err = mpc_err_or(errs, 2);
 }
 
-static int mpc_stack_terminate(mpc_stack_t *s, mpc_result_t *r) {
+static void mpc_stack_delete(mpc_stack_t *s) {
+  free(s->parsers);
+  free(s->states);
+  free(s->results);
+  free(s->returns);
+  free(s);
+}
+
+static int mpc_stack_terminate(mpc_stack_t *s, mpc_result_t *r, mpc_stack_t **cache) {
   int success = s->returns[0];
   
   if (success) {
@@ -784,11 +1255,13 @@ static int mpc_stack_terminate(mpc_stack_t *s, mpc_result_t *r) {
     r->error = s->err;
   }
   
-  free(s->parsers);
-  free(s->states);
-  free(s->results);
-  free(s->returns);
-  free(s);
+  if (*cache == NULL
+  &&  s->parsers_slots <= MPC_STACK_KEEP
+  &&  s->results_slots <= MPC_STACK_KEEP) {
+    *cache = s;
+  } else {
+    mpc_stack_delete(s);
+  }
   
   return success;
 }
@@ -801,15 +1274,7 @@ static void mpc_stack_set_state(mpc_stack_t *s, int x) {
 
 static void mpc_stack_parsers_reserve_more(mpc_stack_t *s) {
   if (s->parsers_num > s->parsers_slots) {
-    s->parsers_slots = ceil((s->parsers_slots+1) * 1.5);
-    s->parsers = realloc(s->parsers, sizeof(mpc_parser_t*) * s->parsers_slots);
-    s->states = realloc(s->states, sizeof(int) * s->parsers_slots);
-  }
-}
-
-static void mpc_stack_parsers_reserve_less(mpc_stack_t *s) {
-  if (s->parsers_slots > pow(s->parsers_num+1, 1.5)) {
-    s->parsers_slots = floor((s->parsers_slots-1) * (1.0/1.5));
+    s->parsers_slots *= 2;
     s->parsers = realloc(s->parsers, sizeof(mpc_parser_t*) * s->parsers_slots);
     s->states = realloc(s->states, sizeof(int) * s->parsers_slots);
   }
@@ -826,7 +1291,6 @@ static void mpc_stack_popp(mpc_stack_t *s, mpc_parser_t **p, int *st) {
   *p = s->parsers[s->parsers_num-1];
   *st = s->states[s->parsers_num-1];
   s->parsers_num--;
-  mpc_stack_parsers_reserve_less(s);
 }
 
 static void mpc_stack_peepp(mpc_stack_t *s, mpc_parser_t **p, int *st) {
@@ -854,15 +1318,7 @@ static mpc_result_t mpc_result_out(mpc_val_t *x) {
 
 static void mpc_stack_results_reserve_more(mpc_stack_t *s) {
   if (s->results_num > s->results_slots) {
-    s->results_slots = ceil((s->results_slots + 1) * 1.5);
-    s->results = realloc(s->results, sizeof(mpc_result_t) * s->results_slots);
-    s->returns = realloc(s->returns, sizeof(int) * s->results_slots);
-  }
-}
-
-static void mpc_stack_results_reserve_less(mpc_stack_t *s) {
-  if ( s->results_slots > pow(s->results_num+1, 1.5)) {
-    s->results_slots = floor((s->results_slots-1) * (1.0/1.5));
+    s->results_slots *= 2;
     s->results = realloc(s->results, sizeof(mpc_result_t) * s->results_slots);
     s->returns = realloc(s->returns, sizeof(int) * s->results_slots);
   }
@@ -880,7 +1336,6 @@ static int mpc_stack_popr(mpc_stack_t *s, mpc_result_t *x) {
   *x = s->results[s->results_num-1];
   r = s->returns[s->results_num-1];
   s->results_num--;
-  mpc_stack_results_reserve_less(s);
   return r;
 }
 
@@ -902,7 +1357,7 @@ static void mpc_stack_popr_out(mpc_stack_t *s, int n, mpc_dtor_t *ds) {
   mpc_result_t x;
   while (n) {
     mpc_stack_popr(s, &x);
-    ds[n-1](x.output);
+    if (!s->dry) { ds[n-1](x.output); }
     n--;
   }
 }
@@ -911,7 +1366,7 @@ static void mpc_stack_popr_out_single(mpc_stack_t *s, int n, mpc_dtor_t dx) {
   mpc_result_t x;
   while (n) {
     mpc_stack_popr(s, &x);
-    dx(x.output);
+    if (!s->dry) { dx(x.output); }
     n--;
   }
 }
@@ -925,7 +1380,7 @@ static void mpc_stack_popr_n(mpc_stack_t *s, int n) {
 }
 
 static mpc_val_t *mpc_stack_merger_out(mpc_stack_t *s, int n, mpc_fold_t f) {
-  mpc_val_t *x = f(n, (mpc_val_t**)(&s->results[s->results_num-n]));
+  mpc_val_t *x = s->dry ? NULL : f(n, (mpc_val_t**)(&s->results[s->results_num-n]));
   mpc_stack_popr_n(s, n);
   return x;
 }
@@ -957,22 +1412,233 @@ static mpc_err_t *mpc_stack_merger_err(mpc_stack_t *s, int n) {
 ** But it is now a pretty ugly beast...
 */
 
+/*
+** Repeating a single character parser with
+** `mpcf_strfold` is how most tokens are built,
+** and is what the regex `*` and `+` compile to.
+** Rather than returning each character as its
+** own string and folding them all together,
+** such a run is matched in one tight loop and
+** the token is copied out once at the end.
+*/
+
+static void mpc_set_add(unsigned char *set, unsigned char c) {
+  set[c >> 3] |= 1 << (c & 7);
+}
+
+static int mpc_set_has(const unsigned char *set, unsigned char c) {
+  return set[c >> 3] & (1 << (c & 7));
+}
+
+/* Fills in the characters a single character parser accepts */
+static int mpc_parser_set(mpc_parser_t *p, unsigned char *set) {
+  
+  int c;
+  const char *s;
+  
+  memset(set, 0, 32);
+  
+  switch (p->type) {
+    case MPC_TYPE_ANY:
+      memset(set, 0xFF, 32);
+      return 1;
+    case MPC_TYPE_SINGLE:
+      mpc_set_add(set, p->data.single.x);
+      return 1;
+    case MPC_TYPE_RANGE:
+      for (c = p->data.range.x; c <= p->data.range.y; c++) {
+        mpc_set_add(set, (unsigned char)c);
+      }
+      return 1;
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+      /* As with strchr, the terminating nul always counts as one of the set */
+      for (s = p->data.string.x; *s; s++) { mpc_set_add(set, *s); }
+      mpc_set_add(set, '\0');
+      if (p->type == MPC_TYPE_NONEOF) {
+        for (c = 0; c < 32; c++) { set[c] = ~set[c]; }
+      }
+      return 1;
+    default: return 0;
+  }
+}
+
+static int mpc_parser_is_span(mpc_parser_t *p) {
+  if (p->type == MPC_TYPE_EXPECT) { p = p->data.expect.x; }
+  return p->type >= MPC_TYPE_ANY && p->type <= MPC_TYPE_SATISFY;
+}
+
+static int mpc_input_span_match(mpc_input_t *i, mpc_parser_t *p) {
+  switch (p->type) {
+    case MPC_TYPE_ANY:     return mpc_input_any(i, NULL);
+    case MPC_TYPE_SINGLE:  return mpc_input_char(i, p->data.single.x, NULL);
+    case MPC_TYPE_RANGE:   return mpc_input_range(i, p->data.range.x, p->data.range.y, NULL);
+    case MPC_TYPE_ONEOF:   return mpc_input_oneof(i, p->data.string.x, NULL);
+    case MPC_TYPE_NONEOF:  return mpc_input_noneof(i, p->data.string.x, NULL);
+    case MPC_TYPE_SATISFY: return mpc_input_satisfy(i, p->data.satisfy.f, NULL);
+    default: return 0;
+  }
+}
+
+static char *mpc_input_span(mpc_input_t *i, mpc_parser_t *p, long *n) {
+  
+  long start = i->state.pos, cap = 16;
+  char *s;
+  
+  if (p->type == MPC_TYPE_EXPECT) { p = p->data.expect.x; }
+  
+  /* Strings and maps are sliced directly, streams are gathered as they go */
+  if (i->type == MPC_INPUT_STRING || i->type == MPC_INPUT_MMAP) {
+    while (mpc_input_span_match(i, p));
+    *n = i->state.pos - start;
+    s = malloc(*n + 1);
+    memcpy(s, i->string + start, *n);
+  } else {
+    *n = 0;
+    s = malloc(cap);
+    while (mpc_input_span_match(i, p)) {
+      if (*n + 1 == cap) { cap *= 2; s = realloc(s, cap); }
+      s[(*n)++] = i->last;
+    }
+  }
+  
+  s[*n] = '\0';
+  return s;
+}
+
+/* The error the final, failing match would have produced */
+static mpc_err_t *mpc_input_span_err(mpc_input_t *i, mpc_parser_t *p) {
+  if (p->type == MPC_TYPE_EXPECT) { return mpc_input_err_new(i, p->data.expect.m); }
+  return mpc_input_err_fail(i, "Incorrect Input");
+}
+
+/*
+** A compiled regex is a flat list of steps, each
+** a character set with a repetition. Since regex
+** repetition in mpc is greedy and never gives
+** characters back, every step is deterministic
+** and the whole match is one pass over the input.
+** The errors recorded along the way are the same
+** ones the equivalent combinators would record.
+*/
+
+static mpc_err_t *mpc_input_re_err(mpc_input_t *i, mpc_re_step_t *x) {
+  if (x->m == NULL) { return mpc_input_err_fail(i, "Incorrect Input"); }
+  return mpc_input_err_new(i, x->m);
+}
+
+static int mpc_input_re(mpc_input_t *i, mpc_stack_t *stk, mpc_pdata_re_t *re, mpc_result_t *r) {
+  
+  int k;
+  long n, start = i->state.pos, len = 0, cap = 16;
+  int stream = i->type != MPC_INPUT_STRING && i->type != MPC_INPUT_MMAP;
+  char *s = stream ? malloc(cap) : NULL;
+  mpc_re_step_t *x;
+  mpc_err_t *e = NULL;
+  int failed = 0;
+  
+  mpc_input_mark(i);
+  
+  for (k = 0; k < re->n && !failed; k++) {
+    
+    x = &re->xs[k];
+    
+    if (x->type == MPC_RE_ANCHOR) {
+      if (!x->f(i->last, mpc_input_peekc(i))) { e = mpc_input_re_err(i, x); failed = 1; }
+      continue;
+    }
+    
+    n = 0;
+    while (mpc_input_set(i, x->set, NULL)) {
+      if (stream) {
+        if (len + 1 == cap) { cap *= 2; s = realloc(s, cap); }
+        s[len++] = i->last;
+      }
+      n++;
+      if (x->type == MPC_RE_ONE || x->type == MPC_RE_MAYBE) { break; }
+    }
+    
+    switch (x->type) {
+      case MPC_RE_ONE:
+        if (n == 0) { e = mpc_input_re_err(i, x); failed = 1; }
+        break;
+      case MPC_RE_MAYBE:
+        if (n == 0) { mpc_stack_err(stk, mpc_input_re_err(i, x)); }
+        break;
+      case MPC_RE_MANY:
+        mpc_stack_err(stk, mpc_input_re_err(i, x));
+        break;
+      case MPC_RE_MANY1:
+        if (n == 0) { e = mpc_err_many1(mpc_input_re_err(i, x)); failed = 1; }
+        else { mpc_stack_err(stk, mpc_input_re_err(i, x)); }
+        break;
+      case MPC_RE_COUNT:
+        if (n != x->n) { e = mpc_err_count(mpc_input_re_err(i, x), x->n); failed = 1; }
+        else { mpc_stack_err(stk, mpc_input_re_err(i, x)); }
+        break;
+    }
+  }
+  
+  if (failed) {
+    mpc_input_rewind(i);
+    free(s);
+    r->error = e;
+    return 0;
+  }
+  
+  mpc_input_unmark(i);
+  
+  if (!stream) {
+    len = i->state.pos - start;
+    s = malloc(len + 1);
+    memcpy(s, i->string + start, len);
+  }
+  s[len] = '\0';
+  r->output = s;
+  return 1;
+}
+
 #define MPC_CONTINUE(st, x) mpc_stack_set_state(stk, st); mpc_stack_pushp(stk, x); continue
 #define MPC_SUCCESS(x) mpc_stack_popp(stk, &p, &st); mpc_stack_pushr(stk, mpc_result_out(x), 1); continue
 #define MPC_FAILURE(x) mpc_stack_popp(stk, &p, &st); mpc_stack_pushr(stk, mpc_result_err(x), 0); continue
-#define MPC_PRIMITIVE(x, f) if (f) { MPC_SUCCESS(x); } else { MPC_FAILURE(mpc_err_fail(i->filename, i->state, "Incorrect Input")); }
+#define MPC_PRIMITIVE(x, f) if (f) { MPC_SUCCESS(mpc_input_out(i, x)); } else { MPC_FAILURE(mpc_input_err_fail(i, "Incorrect Input")); }
 
-int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
+/*
+** Bumped when a retained parser that was already
+** defined is redefined or undefined, which also
+** stamps that parser with the new version. An
+** mpc_or whose table is older than the version
+** checks the retained parsers it can reach, and
+** builds its table again only if one of them was
+** stamped since. Defining a parser for the first
+** time leaves tables as they are, since they
+** treated it as matching anything. Like the rest
+** of grammar building, this is not meant to
+** happen on several threads at once, or while a
+** parse is running.
+*/
+
+static unsigned long mpc_grammar_version = 0;
+
+static int mpc_stale(mpc_parser_t *p, unsigned long version);
+static void mpc_analyse(int n, mpc_parser_t **ps);
+
+static int mpc_parse_run(mpc_input_t *i, mpc_stack_t **cache, mpc_parser_t *init, mpc_result_t *final) {
   
   /* Stack */
   int st = 0;
   mpc_parser_t *p = NULL;
-  mpc_stack_t *stk = mpc_stack_new(i->filename);
+  mpc_stack_t *stk = mpc_stack_new(i->filename, i->quiet, cache);
   
   /* Variables */
-  char *s;
+  char *s, c;
+  long n;
+  int k;
+  mpc_memo_t *m;
   mpc_result_t r;
 
+  stk->dry = i->dry;
+  
   /* Go! */
   mpc_stack_pushp(stk, init);
   
@@ -994,18 +1660,18 @@ int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
       
       /* Other parsers */
       
-      case MPC_TYPE_UNDEFINED: MPC_FAILURE(mpc_err_fail(i->filename, i->state, "Parser Undefined!"));      
+      case MPC_TYPE_UNDEFINED: MPC_FAILURE(mpc_input_err_fail(i, "Parser Undefined!"));      
       case MPC_TYPE_PASS:      MPC_SUCCESS(NULL);
-      case MPC_TYPE_FAIL:      MPC_FAILURE(mpc_err_fail(i->filename, i->state, p->data.fail.m));
-      case MPC_TYPE_LIFT:      MPC_SUCCESS(p->data.lift.lf());
-      case MPC_TYPE_LIFT_VAL:  MPC_SUCCESS(p->data.lift.x);
-      case MPC_TYPE_STATE:     MPC_SUCCESS(mpc_state_copy(i->state));
+      case MPC_TYPE_FAIL:      MPC_FAILURE(mpc_input_err_fail(i, p->data.fail.m));
+      case MPC_TYPE_LIFT:      MPC_SUCCESS(i->dry ? NULL : p->data.lift.lf());
+      case MPC_TYPE_LIFT_VAL:  MPC_SUCCESS(i->dry ? NULL : p->data.lift.x);
+      case MPC_TYPE_STATE:     MPC_SUCCESS(i->dry ? NULL : mpc_state_copy(i->state));
       
       case MPC_TYPE_ANCHOR:
         if (mpc_input_anchor(i, p->data.anchor.f)) {
           MPC_SUCCESS(NULL);
         } else {
-          MPC_FAILURE(mpc_err_new(i->filename, i->state, "anchor", mpc_input_peekc(i)));
+          MPC_FAILURE(mpc_input_err_new(i, "anchor"));
         }
       
       /* Application Parsers */
@@ -1017,7 +1683,7 @@ int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
             MPC_SUCCESS(r.output);
           } else {
             mpc_err_delete(r.error); 
-            MPC_FAILURE(mpc_err_new(i->filename, i->state, p->data.expect.m, mpc_input_peekc(i)));
+            MPC_FAILURE(mpc_input_err_new(i, p->data.expect.m));
           }
         }
       
@@ -1025,7 +1691,7 @@ int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
         if (st == 0) { MPC_CONTINUE(1, p->data.apply.x); }
         if (st == 1) {
           if (mpc_stack_popr(stk, &r)) {
-            MPC_SUCCESS(p->data.apply.f(r.output));
+            MPC_SUCCESS(i->dry ? NULL : p->data.apply.f(r.output));
           } else {
             MPC_FAILURE(r.error);
           }
@@ -1035,7 +1701,7 @@ int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
         if (st == 0) { MPC_CONTINUE(1, p->data.apply_to.x); }
         if (st == 1) {
           if (mpc_stack_popr(stk, &r)) {
-            MPC_SUCCESS(p->data.apply_to.f(r.output, p->data.apply_to.d));
+            MPC_SUCCESS(i->dry ? NULL : p->data.apply_to.f(r.output, p->data.apply_to.d));
           } else {
             MPC_FAILURE(r.error);
           }
@@ -1058,12 +1724,12 @@ int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
         if (st == 1) {
           if (mpc_stack_popr(stk, &r)) {
             mpc_input_rewind(i);
-            p->data.not.dx(r.output);
-            MPC_FAILURE(mpc_err_new(i->filename, i->state, "opposite", mpc_input_peekc(i)));
+            if (!i->dry) { p->data.not.dx(r.output); }
+            MPC_FAILURE(mpc_input_err_new(i, "opposite"));
           } else {
             mpc_input_unmark(i);
             mpc_stack_err(stk, r.error);
-            MPC_SUCCESS(p->data.not.lf());
+            MPC_SUCCESS(i->dry ? NULL : p->data.not.lf());
           }
         }
       
@@ -1074,13 +1740,18 @@ int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
             MPC_SUCCESS(r.output);
           } else {
             mpc_stack_err(stk, r.error);
-            MPC_SUCCESS(p->data.not.lf());
+            MPC_SUCCESS(i->dry ? NULL : p->data.not.lf());
           }
         }
       
       /* Repeat Parsers */
       
       case MPC_TYPE_MANY:
+        if (st == 0 && p->data.repeat.f == mpcf_strfold && mpc_parser_is_span(p->data.repeat.x)) {
+          s = mpc_input_span(i, p->data.repeat.x, &n);
+          mpc_stack_err(stk, mpc_input_span_err(i, p->data.repeat.x));
+          MPC_SUCCESS(mpc_input_out(i, s));
+        }
         if (st == 0) { MPC_CONTINUE(st+1, p->data.repeat.x); }
         if (st >  0) {
           if (mpc_stack_peekr(stk, &r)) {
@@ -1093,6 +1764,16 @@ int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
         }
       
       case MPC_TYPE_MANY1:
+        if (st == 0 && p->data.repeat.f == mpcf_strfold && mpc_parser_is_span(p->data.repeat.x)) {
+          s = mpc_input_span(i, p->data.repeat.x, &n);
+          if (n == 0) {
+            free(s);
+            MPC_FAILURE(mpc_err_many1(mpc_input_span_err(i, p->data.repeat.x)));
+          } else {
+            mpc_stack_err(stk, mpc_input_span_err(i, p->data.repeat.x));
+            MPC_SUCCESS(mpc_input_out(i, s));
+          }
+        }
         if (st == 0) { MPC_CONTINUE(st+1, p->data.repeat.x); }
         if (st >  0) {
           if (mpc_stack_peekr(stk, &r)) {
@@ -1135,6 +1816,30 @@ int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
         
         if (p->data.or.n == 0) { MPC_SUCCESS(NULL); }
         
+        if (st == 0 && p->data.or.first && !p->frozen && p->data.or.version != mpc_grammar_version) {
+          if (mpc_stale(p, p->data.or.version)) {
+            mpc_analyse(1, &p);
+          } else {
+            p->data.or.version = mpc_grammar_version;
+          }
+        }
+        
+        /*
+        ** In a quiet parse, states above n try just the
+        ** alternatives which can match the next character,
+        ** and fail once none of those are left.
+        */
+        
+        if (p->data.or.first && i->quiet && i->backtrack > 0 && (st == 0 || st > p->data.or.n)) {
+          if (st > 0 && mpc_stack_popr(stk, &r)) { MPC_SUCCESS(r.output); }
+          c = mpc_input_peekc(i);
+          for (k = st > 0 ? st - p->data.or.n : 0; k < p->data.or.n; k++) {
+            if (p->data.or.first[k].nullable || mpc_set_has(p->data.or.first[k].set, c)) { break; }
+          }
+          if (k < p->data.or.n) { MPC_CONTINUE(p->data.or.n + 1 + k, p->data.or.xs[k]); }
+          MPC_FAILURE(NULL);
+        }
+        
         if (st == 0) { MPC_CONTINUE(st+1, p->data.or.xs[st]); }
         if (st <= p->data.or.n) {
           if (mpc_stack_peekr(stk, &r)) {
@@ -1148,7 +1853,7 @@ int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
       
       case MPC_TYPE_AND:
         
-        if (p->data.and.n == 0) { MPC_SUCCESS(p->data.and.f(0, NULL)); }
+        if (p->data.and.n == 0) { MPC_SUCCESS(i->dry ? NULL : p->data.and.f(0, NULL)); }
         
         if (st == 0) { mpc_input_mark(i); MPC_CONTINUE(st+1, p->data.and.xs[st]); }
         if (st <= p->data.and.n) {
@@ -1162,15 +1867,54 @@ int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
           if (st == p->data.and.n) { mpc_input_unmark(i); MPC_SUCCESS(mpc_stack_merger_out(stk, p->data.and.n, p->data.and.f)); }
         }
       
+      case MPC_TYPE_RE:
+        if (mpc_input_re(i, stk, &p->data.re, &r)) { MPC_SUCCESS(mpc_input_out(i, r.output)); } else { MPC_FAILURE(r.error); }
+      
+      /* Packrat Parsers */
+      
+      case MPC_TYPE_MEMO:
+        
+        if (!mpc_input_memoable(i)) {
+          if (st == 0) { MPC_CONTINUE(2, p->data.memo.x); }
+          if (mpc_stack_popr(stk, &r)) { MPC_SUCCESS(r.output); } else { MPC_FAILURE(r.error); }
+        }
+        
+        if (st == 0) {
+          m = mpc_input_memo_find(i, p);
+          if (m) {
+            i->state = m->state;
+            i->last = m->last;
+            if (m->success) { MPC_SUCCESS(i->dry ? NULL : p->data.memo.cf(m->r.output)); }
+            else { MPC_FAILURE(mpc_err_copy(m->r.error)); }
+          }
+          mpc_input_mark(i);
+          MPC_CONTINUE(1, p->data.memo.x);
+        }
+        if (st == 1) {
+          n = i->marks[i->marks_num-1].pos;
+          mpc_input_unmark(i);
+          if (mpc_stack_popr(stk, &r)) {
+            if (i->state.pos - n <= MPC_MEMO_WINDOW && i->dry) {
+              mpc_input_memo_add(i, p, n, 1, mpc_result_out(NULL), mpcf_dtor_null);
+            } else if (i->state.pos - n <= MPC_MEMO_WINDOW) {
+              mpc_input_memo_add(i, p, n, 1, mpc_result_out(p->data.memo.cf(r.output)), p->data.memo.dx);
+            }
+            MPC_SUCCESS(r.output);
+          } else {
+            mpc_input_memo_add(i, p, n, 0, mpc_result_err(mpc_err_copy(r.error)), p->data.memo.dx);
+            MPC_FAILURE(r.error);
+          }
+        }
+      
       /* End */
       
       default:
         
-        MPC_FAILURE(mpc_err_fail(i->filename, i->state, "Unknown Parser Type Id!"));
+        MPC_FAILURE(mpc_input_err_fail(i, "Unknown Parser Type Id!"));
     }
   }
   
-  return mpc_stack_terminate(stk, final);
+  return mpc_stack_terminate(stk, final, cache);
   
 }
 
@@ -1179,6 +1923,82 @@ int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
 #undef MPC_FAILURE
 #undef MPC_PRIMITIVE
 
+/*
+** Inputs which can be wound back to the start are
+** first parsed quietly: no errors are built and
+** alternatives are skipped using lookahead. Most
+** parses succeed, and this is all the work done.
+** If it fails the input is parsed again in full,
+** to build the same error as it always has. That
+** second parse is dry, so user functions run just
+** once, in the first. Should it succeed after all,
+** the values are built by a third parse.
+*/
+
+static int mpc_parse_twice(mpc_input_t *i, mpc_stack_t **cache, mpc_parser_t *init, mpc_result_t *final) {
+  
+  int x, j;
+  mpc_state_t state = i->state;
+  char last = i->last;
+  
+  if (!mpc_input_memoable(i)) { return mpc_parse_run(i, cache, init, final); }
+  
+  i->quiet = 1;
+  x = mpc_parse_run(i, cache, init, final);
+  i->quiet = 0;
+  
+  if (x) { return x; }
+  
+  if (i->memo) {
+    for (j = 0; j < MPC_MEMO_WINDOW; j++) { mpc_input_memo_clear(&i->memo[j]); }
+  }
+  
+  i->state = state;
+  i->last = last;
+  
+  i->dry = 1;
+  x = mpc_parse_run(i, cache, init, final);
+  i->dry = 0;
+  
+  if (!x) { return x; }
+  
+  if (i->memo) {
+    for (j = 0; j < MPC_MEMO_WINDOW; j++) { mpc_input_memo_clear(&i->memo[j]); }
+  }
+  
+  i->state = state;
+  i->last = last;
+  
+  return mpc_parse_run(i, cache, init, final);
+}
+
+/* The AST pool is only used by the parse it was given to, not by any parse nested in it */
+static int mpc_parse_stack(mpc_input_t *i, mpc_stack_t **cache, mpc_ast_pool_t *pool, mpc_parser_t *init, mpc_result_t *final) {
+  int x;
+  mpc_ast_pool_t *outer = mpc_ast_pool;
+  mpc_ast_pool = pool;
+  x = mpc_parse_twice(i, cache, init, final);
+  mpc_ast_pool = outer;
+  return x;
+}
+
+int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
+#ifdef MPC_NO_THREAD_LOCAL
+  int x;
+  mpc_stack_t *cache = NULL;
+  x = mpc_parse_stack(i, &cache, NULL, init, final);
+  if (cache) { mpc_stack_delete(cache); }
+  return x;
+#else
+  return mpc_parse_stack(i, &mpc_stack_cache, NULL, init, final);
+#endif
+}
+
+void mpc_stack_cache_free(void) {
+  if (mpc_stack_cache) { mpc_stack_delete(mpc_stack_cache); }
+  mpc_stack_cache = NULL;
+}
+
 int mpc_parse(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r) {
   int x;
   mpc_input_t *i = mpc_input_new_string(filename, string);
@@ -1187,9 +2007,18 @@ int mpc_parse(const char *filename, const char *string, mpc_parser_t *p, mpc_res
   return x;
 }
 
+int mpc_parse_n(const char *filename, const char *string, long length, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_nstring(filename, string, length);
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
+}
+
 int mpc_parse_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r) {
   int x;
-  mpc_input_t *i = mpc_input_new_file(filename, file);
+  mpc_input_t *i = mpc_input_new_mmap(filename, file);
+  if (i == NULL) { i = mpc_input_new_file(filename, file); }
   x = mpc_parse_input(i, p, r);
   mpc_input_delete(i);
   return x;
@@ -1219,12 +2048,81 @@ int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
   return res;
 }
 
+/*
+** Context Type
+**
+** A context keeps the input and stack of its last
+** parse, along with everything they have grown to
+** hold, and resets them for the next one. Parsing
+** with a context allocates only what the parse
+** itself returns, and with an AST pool most of
+** that comes from the pool. Nothing in a context
+** is shared, so each thread can safely use one of
+** its own.
+*/
+
+struct mpc_context_t {
+  int flags;
+  mpc_input_t *input;
+  mpc_stack_t *stack;
+  mpc_ast_pool_t pool;
+};
+
+mpc_context_t *mpc_context_new(int flags) {
+  mpc_context_t *c = malloc(sizeof(mpc_context_t));
+  c->flags = flags;
+  c->input = NULL;
+  c->stack = NULL;
+  c->pool.first = NULL;
+  c->pool.curr = NULL;
+  return c;
+}
+
+void mpc_context_delete(mpc_context_t *c) {
+  if (c->input) { mpc_input_delete(c->input); }
+  if (c->stack) { mpc_stack_delete(c->stack); }
+  mpc_ast_pool_free(&c->pool);
+  free(c);
+}
+
+int mpc_context_parse_n(mpc_context_t *c, const char *filename, const char *string, long length, mpc_parser_t *p, mpc_result_t *r) {
+  
+  if (c->input == NULL) {
+    c->input = mpc_input_new_nstring(filename, string, length);
+  } else {
+    mpc_input_reset_nstring(c->input, filename, string, length);
+  }
+  
+  if (!(c->flags & MPC_CONTEXT_POOL_AST)) {
+    return mpc_parse_stack(c->input, &c->stack, NULL, p, r);
+  }
+  
+  /* The trees from the last parse go now */
+  mpc_ast_pool_reset(&c->pool);
+  return mpc_parse_stack(c->input, &c->stack, &c->pool, p, r);
+}
+
+int mpc_context_parse(mpc_context_t *c, const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r) {
+  return mpc_context_parse_n(c, filename, string, strlen(string), p, r);
+}
+
 /*
 ** Building a Parser
 */
 
 static void mpc_undefine_unretained(mpc_parser_t *p, int force);
 
+static void mpc_undefine_re(mpc_parser_t *p) {
+  
+  int i;
+  for (i = 0; i < p->data.re.n; i++) {
+    free(p->data.re.xs[i].m);
+  }
+  free(p->data.re.xs);
+  free(p->data.re.re);
+  
+}
+
 static void mpc_undefine_or(mpc_parser_t *p) {
   
   int i;
@@ -1232,6 +2130,7 @@ static void mpc_undefine_or(mpc_parser_t *p) {
     mpc_undefine_unretained(p->data.or.xs[i], 0);
   }
   free(p->data.or.xs);
+  free(p->data.or.first);
   
 }
 
@@ -1283,6 +2182,10 @@ static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
     case MPC_TYPE_OR:  mpc_undefine_or(p);  break;
     case MPC_TYPE_AND: mpc_undefine_and(p); break;
     
+    case MPC_TYPE_MEMO: mpc_undefine_unretained(p->data.memo.x, 0); break;
+    
+    case MPC_TYPE_RE: mpc_undefine_re(p); break;
+    
     default: break;
   }
   
@@ -1328,15 +2231,34 @@ mpc_parser_t *mpc_new(const char *name) {
   return p;
 }
 
-mpc_parser_t *mpc_undefine(mpc_parser_t *p) {
+static void mpc_changed(mpc_parser_t *p) {
+  if (p->type == MPC_TYPE_UNDEFINED) { return; }
+  p->changed = ++mpc_grammar_version;
+}
+
+static void mpc_undefine_parser(mpc_parser_t *p) {
   mpc_undefine_unretained(p, 1);
   p->type = MPC_TYPE_UNDEFINED;
+  p->frozen = 0;
+}
+
+mpc_parser_t *mpc_undefine(mpc_parser_t *p) {
+  mpc_changed(p);
+  mpc_undefine_parser(p);
   return p;
 }
 
 mpc_parser_t *mpc_define(mpc_parser_t *p, mpc_parser_t *a) {
   
+  /* A frozen parser may be in use on other threads, so it is never changed */
+  if (p->frozen) {
+    fprintf(stderr, "mpc: cannot define frozen parser '%s'\n", p->name ? p->name : "");
+    mpc_delete(a);
+    return NULL;
+  }
+  
   if (p->retained) {
+    mpc_changed(p);
     p->type = a->type;
     p->data = a->data;
   } else {
@@ -1357,11 +2279,13 @@ void mpc_cleanup(int n, ...) {
   va_list va;
   va_start(va, n);
   for (i = 0; i < n; i++) { list[i] = va_arg(va, mpc_parser_t*); }
-  for (i = 0; i < n; i++) { mpc_undefine(list[i]); }
+  /* Nothing can still use these, so no table is made stale */
+  for (i = 0; i < n; i++) { mpc_undefine_parser(list[i]); }
   for (i = 0; i < n; i++) { mpc_delete(list[i]); }  
   va_end(va);  
 
   free(list);
+  mpc_stack_cache_free();
 }
 
 mpc_parser_t *mpc_pass(void) {
@@ -1576,6 +2500,15 @@ mpc_parser_t *mpc_predictive(mpc_parser_t *a) {
   return p;
 }
 
+mpc_parser_t *mpc_memo(mpc_parser_t *a, mpc_apply_t cf, mpc_dtor_t da) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_MEMO;
+  p->data.memo.x = a;
+  p->data.memo.cf = cf;
+  p->data.memo.dx = da;
+  return p;
+}
+
 mpc_parser_t *mpc_not_lift(mpc_parser_t *a, mpc_dtor_t da, mpc_ctor_t lf) {
   mpc_parser_t *p = mpc_undefined();
   p->type = MPC_TYPE_NOT;
@@ -1998,12 +2931,108 @@ static mpc_val_t *mpcf_re_range(mpc_val_t *x) {
   
   }
   
-  out = comp == 1 ? mpc_noneof(range) : mpc_oneof(range);
+  out = comp == 1 ? mpc_noneof(range) : mpc_oneof(range);
+  
+  free(x);
+  free(range);
+  
+  return out;
+}
+
+/*
+** Regexes built only from single characters,
+** sets, anchors and the repeats `?`, `*`, `+` and
+** `{n}` are compiled into an MPC_TYPE_RE parser.
+** Anything else (groups, alternation, `\\w`...)
+** keeps the combinator tree built above.
+*/
+
+static int mpc_re_compile_atom(mpc_parser_t *p, mpc_re_step_t *x) {
+  
+  const char *m = NULL;
+  
+  /* The outermost expectation is the one that gets reported */
+  if (p->type == MPC_TYPE_EXPECT) { m = p->data.expect.m; }
+  while (p->type == MPC_TYPE_EXPECT) { p = p->data.expect.x; }
+  
+  if (!mpc_parser_set(p, x->set)) { return 0; }
+  
+  x->m = NULL;
+  if (m) {
+    x->m = malloc(strlen(m) + 1);
+    strcpy(x->m, m);
+  }
+  return 1;
+}
+
+static int mpc_re_compile_step(mpc_parser_t *p, mpc_re_step_t *x) {
+  
+  x->n = 0;
+  x->f = NULL;
   
-  free(x);
-  free(range);
+  /* Anchors such as `^` and `$` are `mpc_and(2, mpcf_snd, anchor, lift)` */
+  if (p->type == MPC_TYPE_AND && p->data.and.n == 2 && p->data.and.f == mpcf_snd &&
+      p->data.and.xs[0]->type == MPC_TYPE_EXPECT &&
+      p->data.and.xs[0]->data.expect.x->type == MPC_TYPE_ANCHOR &&
+      p->data.and.xs[1]->type == MPC_TYPE_LIFT &&
+      p->data.and.xs[1]->data.lift.lf == mpcf_ctor_str) {
+    x->type = MPC_RE_ANCHOR;
+    x->f = p->data.and.xs[0]->data.expect.x->data.anchor.f;
+    x->m = malloc(strlen(p->data.and.xs[0]->data.expect.m) + 1);
+    strcpy(x->m, p->data.and.xs[0]->data.expect.m);
+    memset(x->set, 0, sizeof(x->set));
+    return 1;
+  }
   
-  return out;
+  if (p->type == MPC_TYPE_MAYBE && p->data.not.lf == mpcf_ctor_str) {
+    x->type = MPC_RE_MAYBE;
+    return mpc_re_compile_atom(p->data.not.x, x);
+  }
+  
+  if ((p->type == MPC_TYPE_MANY || p->type == MPC_TYPE_MANY1 || p->type == MPC_TYPE_COUNT) &&
+      p->data.repeat.f == mpcf_strfold) {
+    x->type = p->type == MPC_TYPE_MANY  ? MPC_RE_MANY :
+              p->type == MPC_TYPE_MANY1 ? MPC_RE_MANY1 : MPC_RE_COUNT;
+    x->n = p->data.repeat.n;
+    return mpc_re_compile_atom(p->data.repeat.x, x);
+  }
+  
+  x->type = MPC_RE_ONE;
+  return mpc_re_compile_atom(p, x);
+}
+
+/* A term is `mpc_lift(mpcf_ctor_str)` folded with `mpc_and(2, mpcf_strfold, term, step)` */
+static int mpc_re_compile_term(mpc_parser_t *p, mpc_pdata_re_t *re) {
+  
+  if (p->type == MPC_TYPE_LIFT && p->data.lift.lf == mpcf_ctor_str) { return 1; }
+  
+  if (p->type == MPC_TYPE_AND && p->data.and.n == 2 && p->data.and.f == mpcf_strfold) {
+    if (!mpc_re_compile_term(p->data.and.xs[0], re)) { return 0; }
+    re->xs = realloc(re->xs, sizeof(mpc_re_step_t) * (re->n + 1));
+    if (!mpc_re_compile_step(p->data.and.xs[1], &re->xs[re->n])) { return 0; }
+    re->n++;
+    return 1;
+  }
+  
+  return 0;
+}
+
+static mpc_parser_t *mpc_re_compile(mpc_parser_t *p, const char *re) {
+  
+  mpc_parser_t *q = mpc_undefined();
+  q->type = MPC_TYPE_RE;
+  q->data.re.n = 0;
+  q->data.re.xs = NULL;
+  q->data.re.re = malloc(strlen(re) + 1);
+  strcpy(q->data.re.re, re);
+  
+  if (!mpc_re_compile_term(p, &q->data.re)) {
+    mpc_delete(q);
+    return p;
+  }
+  
+  mpc_delete(p);
+  return q;
 }
 
 mpc_parser_t *mpc_re(const char *re) {
@@ -2056,6 +3085,8 @@ mpc_parser_t *mpc_re(const char *re) {
     mpc_err_delete(r.error);  
     free(err_msg);
     r.output = err_out;
+  } else {
+    r.output = mpc_re_compile(r.output, re);
   }
   
   mpc_delete(RegexEnclose);
@@ -2284,13 +3315,22 @@ mpc_val_t *mpcf_trd_free(int n, mpc_val_t **xs) { return mpcf_nth_free(n, xs, 2)
 
 mpc_val_t *mpcf_strfold(int n, mpc_val_t **xs) {
   int i;
-  char *x = calloc(1, 1);
-
+  size_t l = 0, m;
+  char *x;
+  
+  for (i = 0; i < n; i++) { l += strlen(xs[i]); }
+  
+  x = malloc(l + 1);
+  l = 0;
+  
   for (i = 0; i < n; i++) {
-    x = realloc(x, strlen(x) + strlen(xs[i]) + 1);
-    strcat(x, xs[i]);
+    m = strlen(xs[i]);
+    memcpy(x + l, xs[i], m);
+    l += m;
     free(xs[i]);
   }
+  
+  x[l] = '\0';
   return x;
 }
 
@@ -2309,6 +3349,283 @@ mpc_val_t *mpcf_maths(int n, mpc_val_t **xs) {
   return xs[0];
 }
 
+/*
+** Lookahead
+**
+** Once `mpca_lang` has defined a grammar, the
+** set of characters each parser can start with
+** (its FIRST set), and whether it can succeed
+** without consuming anything, is worked out for
+** the whole grammar. Every `mpc_or` keeps the
+** result for its alternatives, so that parsing
+** only tries those which can match the next
+** character. Anything unclear, such as left
+** recursion or a parser still undefined, is
+** assumed to match anything. A table built
+** before a parser it reaches was redefined or
+** undefined is built again the next time its
+** mpc_or is run.
+*/
+
+typedef struct {
+  mpc_parser_t *p;
+  int done;
+  mpc_first_t first;
+} mpc_first_memo_t;
+
+typedef struct {
+  int memos_num;
+  mpc_first_memo_t *memos;
+} mpc_first_st_t;
+
+static void mpc_first_any(mpc_first_t *f) {
+  memset(f->set, 0xFF, sizeof(f->set));
+  f->nullable = 1;
+}
+
+static void mpc_first_none(mpc_first_t *f, int nullable) {
+  memset(f->set, 0, sizeof(f->set));
+  f->nullable = nullable;
+}
+
+static void mpc_first_union(mpc_first_t *f, const mpc_first_t *g) {
+  int i;
+  for (i = 0; i < 32; i++) { f->set[i] |= g->set[i]; }
+}
+
+static void mpc_first(mpc_parser_t *p, mpc_first_st_t *st, mpc_first_t *f) {
+  
+  int i, j;
+  mpc_first_t g;
+  
+  for (i = 0; i < st->memos_num; i++) {
+    if (st->memos[i].p != p) { continue; }
+    if (st->memos[i].done) { *f = st->memos[i].first; } else { mpc_first_any(f); }
+    return;
+  }
+  
+  j = st->memos_num++;
+  st->memos = realloc(st->memos, sizeof(mpc_first_memo_t) * st->memos_num);
+  st->memos[j].p = p;
+  st->memos[j].done = 0;
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_PASS:
+    case MPC_TYPE_LIFT:
+    case MPC_TYPE_LIFT_VAL:
+    case MPC_TYPE_STATE:
+    case MPC_TYPE_ANCHOR:   mpc_first_none(f, 1); break;
+    case MPC_TYPE_FAIL:     mpc_first_none(f, 0); break;
+    
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_SINGLE:
+    case MPC_TYPE_RANGE:
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+      mpc_parser_set(p, f->set);
+      f->nullable = 0;
+      break;
+    
+    case MPC_TYPE_STRING:
+      mpc_first_none(f, p->data.string.x[0] == '\0');
+      mpc_set_add(f->set, p->data.string.x[0]);
+      break;
+    
+    case MPC_TYPE_EXPECT:   mpc_first(p->data.expect.x, st, f); break;
+    case MPC_TYPE_APPLY:    mpc_first(p->data.apply.x, st, f); break;
+    case MPC_TYPE_APPLY_TO: mpc_first(p->data.apply_to.x, st, f); break;
+    case MPC_TYPE_PREDICT:  mpc_first(p->data.predict.x, st, f); break;
+    case MPC_TYPE_MEMO:     mpc_first(p->data.memo.x, st, f); break;
+    
+    case MPC_TYPE_MAYBE:
+    case MPC_TYPE_MANY:
+      mpc_first(p->type == MPC_TYPE_MAYBE ? p->data.not.x : p->data.repeat.x, st, f);
+      f->nullable = 1;
+      break;
+    
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:
+      mpc_first(p->data.repeat.x, st, f);
+      if (p->type == MPC_TYPE_COUNT && p->data.repeat.n == 0) { f->nullable = 1; }
+      break;
+    
+    case MPC_TYPE_OR:
+      /* A frozen parser may be in use, so its table is read but not rebuilt */
+      if (!p->frozen) {
+        free(p->data.or.first);
+        p->data.or.first = malloc(sizeof(mpc_first_t) * p->data.or.n);
+        for (i = 0; i < p->data.or.n; i++) {
+          mpc_first(p->data.or.xs[i], st, &p->data.or.first[i]);
+        }
+        p->data.or.version = mpc_grammar_version;
+      }
+      if (p->data.or.n > 0 && p->data.or.first == NULL) { mpc_first_any(f); break; }
+      mpc_first_none(f, p->data.or.n == 0);
+      for (i = 0; i < p->data.or.n; i++) {
+        mpc_first_union(f, &p->data.or.first[i]);
+        f->nullable = f->nullable || p->data.or.first[i].nullable;
+      }
+      break;
+    
+    case MPC_TYPE_AND:
+      mpc_first_none(f, 1);
+      for (i = 0; i < p->data.and.n && f->nullable; i++) {
+        mpc_first(p->data.and.xs[i], st, &g);
+        mpc_first_union(f, &g);
+        f->nullable = g.nullable;
+      }
+      break;
+    
+    case MPC_TYPE_RE:
+      mpc_first_none(f, 1);
+      for (i = 0; i < p->data.re.n && f->nullable; i++) {
+        if (p->data.re.xs[i].type == MPC_RE_ANCHOR) { continue; }
+        for (j = 0; j < 32; j++) { f->set[j] |= p->data.re.xs[i].set[j]; }
+        f->nullable = p->data.re.xs[i].type == MPC_RE_MAYBE
+                   || p->data.re.xs[i].type == MPC_RE_MANY
+                   || (p->data.re.xs[i].type == MPC_RE_COUNT && p->data.re.xs[i].n == 0);
+      }
+      break;
+    
+    default: mpc_first_any(f); break;
+  }
+  
+  /* Find the entry again, the table may have moved */
+  for (i = 0; i < st->memos_num; i++) {
+    if (st->memos[i].p == p) {
+      st->memos[i].first = *f;
+      st->memos[i].done = 1;
+      break;
+    }
+  }
+}
+
+static void mpc_analyse(int n, mpc_parser_t **ps) {
+  
+  int i;
+  mpc_first_t f;
+  mpc_first_st_t st;
+  st.memos_num = 0;
+  st.memos = NULL;
+  
+  /* mpca_lang leaves NULL where a grammar named a parser it was not given */
+  for (i = 0; i < n; i++) {
+    if (ps[i]) { mpc_first(ps[i], &st, &f); }
+  }
+  
+  free(st.memos);
+}
+
+/*
+** Walks everything `p` reaches, and reports if a
+** retained parser among them was stamped after
+** `version`. Cycles can only go through retained
+** parsers, so only those are remembered.
+*/
+
+static int mpc_stale_walk(mpc_parser_t *p, unsigned long version, mpc_first_st_t *st) {
+  
+  int i;
+  
+  if (p->retained) {
+    for (i = 0; i < st->memos_num; i++) {
+      if (st->memos[i].p == p) { return 0; }
+    }
+    st->memos_num++;
+    st->memos = realloc(st->memos, sizeof(mpc_first_memo_t) * st->memos_num);
+    st->memos[st->memos_num-1].p = p;
+    if (p->changed > version) { return 1; }
+  }
+  
+  switch (p->type) {
+    case MPC_TYPE_EXPECT:   return mpc_stale_walk(p->data.expect.x, version, st);
+    case MPC_TYPE_APPLY:    return mpc_stale_walk(p->data.apply.x, version, st);
+    case MPC_TYPE_APPLY_TO: return mpc_stale_walk(p->data.apply_to.x, version, st);
+    case MPC_TYPE_PREDICT:  return mpc_stale_walk(p->data.predict.x, version, st);
+    case MPC_TYPE_MEMO:     return mpc_stale_walk(p->data.memo.x, version, st);
+    
+    case MPC_TYPE_NOT:
+    case MPC_TYPE_MAYBE:    return mpc_stale_walk(p->data.not.x, version, st);
+    
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:    return mpc_stale_walk(p->data.repeat.x, version, st);
+    
+    case MPC_TYPE_OR:
+      for (i = 0; i < p->data.or.n; i++) {
+        if (mpc_stale_walk(p->data.or.xs[i], version, st)) { return 1; }
+      }
+      return 0;
+    
+    case MPC_TYPE_AND:
+      for (i = 0; i < p->data.and.n; i++) {
+        if (mpc_stale_walk(p->data.and.xs[i], version, st)) { return 1; }
+      }
+      return 0;
+    
+    default: return 0;
+  }
+}
+
+static int mpc_stale(mpc_parser_t *p, unsigned long version) {
+  
+  int r;
+  mpc_first_st_t st;
+  st.memos_num = 0;
+  st.memos = NULL;
+  
+  r = mpc_stale_walk(p, version, &st);
+  
+  free(st.memos);
+  return r;
+}
+
+static void mpc_freeze_all(mpc_parser_t *p) {
+  
+  int i;
+  
+  if (p->frozen) { return; }
+  p->frozen = 1;
+  
+  switch (p->type) {
+    case MPC_TYPE_EXPECT:   mpc_freeze_all(p->data.expect.x); break;
+    case MPC_TYPE_APPLY:    mpc_freeze_all(p->data.apply.x); break;
+    case MPC_TYPE_APPLY_TO: mpc_freeze_all(p->data.apply_to.x); break;
+    case MPC_TYPE_PREDICT:  mpc_freeze_all(p->data.predict.x); break;
+    case MPC_TYPE_MEMO:     mpc_freeze_all(p->data.memo.x); break;
+    
+    case MPC_TYPE_NOT:
+    case MPC_TYPE_MAYBE:    mpc_freeze_all(p->data.not.x); break;
+    
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:    mpc_freeze_all(p->data.repeat.x); break;
+    
+    case MPC_TYPE_OR:
+      for (i = 0; i < p->data.or.n; i++) { mpc_freeze_all(p->data.or.xs[i]); }
+      break;
+    
+    case MPC_TYPE_AND:
+      for (i = 0; i < p->data.and.n; i++) { mpc_freeze_all(p->data.and.xs[i]); }
+      break;
+    
+    default: break;
+  }
+}
+
+/*
+** Lookahead is worked out before freezing, so a
+** grammar built from combinators alone gets its
+** tables too. Parts already frozen keep theirs.
+*/
+
+void mpc_freeze(mpc_parser_t *p) {
+  if (p->frozen) { return; }
+  mpc_analyse(1, &p);
+  mpc_freeze_all(p);
+}
+
 /*
 ** Printing
 */
@@ -2397,6 +3714,8 @@ static void mpc_print_unretained(mpc_parser_t *p, int force) {
   if (p->type == MPC_TYPE_APPLY)    { mpc_print_unretained(p->data.apply.x, 0); }
   if (p->type == MPC_TYPE_APPLY_TO) { mpc_print_unretained(p->data.apply_to.x, 0); }
   if (p->type == MPC_TYPE_PREDICT)  { mpc_print_unretained(p->data.predict.x, 0); }
+  if (p->type == MPC_TYPE_MEMO)     { mpc_print_unretained(p->data.memo.x, 0); }
+  if (p->type == MPC_TYPE_RE)       { printf("/%s/", p->data.re.re); }
 
   if (p->type == MPC_TYPE_NOT)   { mpc_print_unretained(p->data.not.x, 0); printf("!"); }
   if (p->type == MPC_TYPE_MAYBE) { mpc_print_unretained(p->data.not.x, 0); printf("?"); }
@@ -2502,11 +3821,105 @@ int mpc_test_pass(mpc_parser_t *p, const char *s, const void *d,
 ** AST
 */
 
+/*
+** Tag names are interned when a grammar is built.
+** Each keeps its bit, and the root tag ">" always
+** has the first one. Tags set from an interned
+** name get their bits without looking anything up.
+** Names with a bit sit in a table that never moves
+** and names past the last bit have none, so that
+** parsing on many threads can read the table.
+*/
+
+#define MPC_TAG_BITS ((int)(sizeof(unsigned long) * CHAR_BIT))
+
+typedef struct mpc_tag_name_t {
+  char *name;
+  unsigned long flag;
+  struct mpc_tag_name_t *next;
+} mpc_tag_name_t;
+
+static char mpc_tag_root_name[] = ">";
+static char mpc_tag_none_name[] = "";
+static mpc_tag_name_t mpc_tag_root = { mpc_tag_root_name, 1, NULL };
+static mpc_tag_name_t mpc_tag_none = { mpc_tag_none_name, 0, NULL };
+
+static int mpc_tag_names_num = 1;
+static mpc_tag_name_t *mpc_tag_names[sizeof(unsigned long) * CHAR_BIT] = { &mpc_tag_root };
+static mpc_tag_name_t *mpc_tag_rest = NULL;
+
+static mpc_tag_name_t *mpc_tag_intern(const char *name) {
+  
+  int i;
+  mpc_tag_name_t *t;
+  
+  for (i = 0; i < mpc_tag_names_num; i++) {
+    if (strcmp(mpc_tag_names[i]->name, name) == 0) { return mpc_tag_names[i]; }
+  }
+  
+  for (t = mpc_tag_rest; t; t = t->next) {
+    if (strcmp(t->name, name) == 0) { return t; }
+  }
+  
+  t = malloc(sizeof(mpc_tag_name_t));
+  t->name = malloc(strlen(name) + 1);
+  strcpy(t->name, name);
+  
+  if (mpc_tag_names_num < MPC_TAG_BITS) {
+    t->flag = 1UL << mpc_tag_names_num;
+    t->next = NULL;
+    mpc_tag_names[mpc_tag_names_num] = t;
+    mpc_tag_names_num++;
+  } else {
+    t->flag = 0;
+    t->next = mpc_tag_rest;
+    mpc_tag_rest = t;
+  }
+  
+  return t;
+}
+
+unsigned long mpc_tag_flag(const char *name) {
+  return mpc_tag_intern(name)->flag;
+}
+
+/* The bits for any tag, found without adding names */
+static unsigned long mpc_tag_find(const char *tag) {
+  
+  int i;
+  size_t n;
+  unsigned long tags = 0;
+  
+  while (1) {
+    n = strcspn(tag, "|");
+    if (n == 1 && tag[0] == '>') { tags |= mpc_tag_root.flag; }
+    for (i = 1; i < mpc_tag_names_num && n > 0; i++) {
+      if (strncmp(mpc_tag_names[i]->name, tag, n) == 0 && mpc_tag_names[i]->name[n] == '\0') {
+        tags |= mpc_tag_names[i]->flag;
+        break;
+      }
+    }
+    if (tag[n] == '\0') { return tags; }
+    tag += n + 1;
+  }
+}
+
+/* Memory for a node's parts: pooled nodes take theirs from the pool */
+static void *mpc_ast_alloc(size_t n) {
+  return mpc_ast_pool ? mpc_ast_pool_alloc(mpc_ast_pool, n) : malloc(n);
+}
+
+static char *mpc_ast_strdup(const char *s) {
+  char *r = mpc_ast_alloc(strlen(s) + 1);
+  strcpy(r, s);
+  return r;
+}
+
 void mpc_ast_delete(mpc_ast_t *a) {
   
   int i;
   
-  if (a == NULL) { return; }
+  if (a == NULL || a->pooled) { return; }
   
   for (i = 0; i < a->children_num; i++) {
     mpc_ast_delete(a->children[i]);
@@ -2520,30 +3933,68 @@ void mpc_ast_delete(mpc_ast_t *a) {
 }
 
 static void mpc_ast_delete_no_children(mpc_ast_t *a) {
+  if (a->pooled) { return; }
   free(a->children);
   free(a->tag);
   free(a->contents);
   free(a);
 }
 
-mpc_ast_t *mpc_ast_new(const char *tag, const char *contents) {
+/* A pooled node can use an interned name as its tag, as neither is ever freed */
+static mpc_ast_t *mpc_ast_new_interned(mpc_tag_name_t *t, const char *contents) {
   
-  mpc_ast_t *a = malloc(sizeof(mpc_ast_t));
+  mpc_ast_t *a = mpc_ast_alloc(sizeof(mpc_ast_t));
+  
+  a->pooled = mpc_ast_pool != NULL;
+  a->tag = a->pooled ? t->name : mpc_ast_strdup(t->name);
+  a->tags = t->flag;
+  a->contents = mpc_ast_strdup(contents);
+  a->state = mpc_state_new();
+  a->children_num = 0;
+  a->children = NULL;
+  return a;
   
-  a->tag = malloc(strlen(tag) + 1);
-  strcpy(a->tag, tag);
+}
+
+mpc_ast_t *mpc_ast_new(const char *tag, const char *contents) {
   
-  a->contents = malloc(strlen(contents) + 1);
-  strcpy(a->contents, contents);
+  mpc_ast_t *a = mpc_ast_alloc(sizeof(mpc_ast_t));
   
+  a->pooled = mpc_ast_pool != NULL;
+  a->tag = mpc_ast_strdup(tag);
+  a->tags = mpc_tag_find(tag);
+  a->contents = mpc_ast_strdup(contents);
   a->state = mpc_state_new();
-  
   a->children_num = 0;
   a->children = NULL;
   return a;
   
 }
 
+mpc_ast_t *mpc_ast_copy(mpc_ast_t *a) {
+  
+  int i, slots;
+  mpc_ast_t *r;
+  
+  if (a == NULL) { return NULL; }
+  
+  r = mpc_ast_new(a->tag, a->contents);
+  r->tags = a->tags;
+  r->state = a->state;
+  r->children_num = a->children_num;
+  
+  /* Pooled children arrays are sized in powers of two, see `mpc_ast_add_child` */
+  slots = a->children_num;
+  if (r->pooled) { for (slots = 1; slots < a->children_num; slots *= 2); }
+  
+  r->children = mpc_ast_alloc(sizeof(mpc_ast_t*) * slots);
+  for (i = 0; i < a->children_num; i++) {
+    r->children[i] = mpc_ast_copy(a->children[i]);
+  }
+  
+  return r;
+}
+
 mpc_ast_t *mpc_ast_build(int n, const char *tag, ...) {
   
   mpc_ast_t *a = mpc_ast_new(tag, "");
@@ -2570,7 +4021,7 @@ mpc_ast_t *mpc_ast_add_root(mpc_ast_t *a) {
   if (a->children_num == 0) { return a; }
   if (a->children_num == 1) { return a; }
 
-  r = mpc_ast_new(">", "");
+  r = mpc_ast_new_interned(&mpc_tag_root, "");
   mpc_ast_add_child(r, a);
   return r;
 }
@@ -2590,25 +4041,84 @@ int mpc_ast_eq(mpc_ast_t *a, mpc_ast_t *b) {
   return 1;
 }
 
+/*
+** A pooled node cannot realloc its children, so
+** they double in size instead, moving when the
+** count reaches a power of two.
+*/
+
 mpc_ast_t *mpc_ast_add_child(mpc_ast_t *r, mpc_ast_t *a) {
+  
+  mpc_ast_t **children;
+  
+  if (r->pooled) {
+    if ((r->children_num & (r->children_num - 1)) == 0) {
+      children = mpc_ast_alloc(sizeof(mpc_ast_t*) * (r->children_num ? r->children_num * 2 : 1));
+      if (r->children_num) { memcpy(children, r->children, sizeof(mpc_ast_t*) * r->children_num); }
+      r->children = children;
+    }
+    r->children[r->children_num++] = a;
+    return r;
+  }
+  
   r->children_num++;
   r->children = realloc(r->children, sizeof(mpc_ast_t*) * r->children_num);
   r->children[r->children_num-1] = a;
   return r;
 }
 
+static mpc_ast_t *mpc_ast_add_tag_interned(mpc_ast_t *a, mpc_tag_name_t *t) {
+  
+  size_t n, m;
+  char *tag;
+  
+  if (a == NULL) { return a; }
+  
+  n = strlen(t->name);
+  m = strlen(a->tag);
+  
+  if (a->pooled) {
+    tag = mpc_ast_alloc(n + 1 + m + 1);
+    memcpy(tag + n + 1, a->tag, m + 1);
+  } else {
+    tag = realloc(a->tag, n + 1 + m + 1);
+    memmove(tag + n + 1, tag, m + 1);
+  }
+  
+  memcpy(tag, t->name, n);
+  tag[n] = '|';
+  a->tag = tag;
+  a->tags |= t->flag;
+  return a;
+}
+
 mpc_ast_t *mpc_ast_add_tag(mpc_ast_t *a, const char *t) {
+  mpc_tag_name_t name;
   if (a == NULL) { return a; }
-  a->tag = realloc(a->tag, strlen(t) + 1 + strlen(a->tag) + 1);
-  memmove(a->tag + strlen(t) + 1, a->tag, strlen(a->tag)+1);
-  memmove(a->tag, t, strlen(t));
-  memmove(a->tag + strlen(t), "|", 1);
+  name.name = (char*)t;
+  name.flag = mpc_tag_find(t);
+  return mpc_ast_add_tag_interned(a, &name);
+}
+
+static mpc_ast_t *mpc_ast_tag_interned(mpc_ast_t *a, mpc_tag_name_t *t) {
+  if (a->pooled) {
+    a->tag = t->name;
+  } else {
+    a->tag = realloc(a->tag, strlen(t->name) + 1);
+    strcpy(a->tag, t->name);
+  }
+  a->tags = t->flag;
   return a;
 }
 
 mpc_ast_t *mpc_ast_tag(mpc_ast_t *a, const char *t) {
-  a->tag = realloc(a->tag, strlen(t) + 1);
-  strcpy(a->tag, t);
+  if (a->pooled) {
+    a->tag = mpc_ast_strdup(t);
+  } else {
+    a->tag = realloc(a->tag, strlen(t) + 1);
+    strcpy(a->tag, t);
+  }
+  a->tags = mpc_tag_find(t);
   return a;
 }
 
@@ -2663,7 +4173,7 @@ mpc_val_t *mpcf_fold_ast(int n, mpc_val_t **xs) {
   if (n == 2 && xs[1] == NULL) { return xs[0]; }
   if (n == 2 && xs[0] == NULL) { return xs[1]; }
   
-  r = mpc_ast_new(">", "");
+  r = mpc_ast_new_interned(&mpc_tag_root, "");
   
   for (i = 0; i < n; i++) {
     
@@ -2691,8 +4201,24 @@ mpc_val_t *mpcf_fold_ast(int n, mpc_val_t **xs) {
 }
 
 mpc_val_t *mpcf_str_ast(mpc_val_t *c) {
-  mpc_ast_t *a = mpc_ast_new("", c);
-  free(c);
+  
+  mpc_ast_t *a;
+  
+  if (mpc_ast_pool) {
+    a = mpc_ast_new_interned(&mpc_tag_none, c);
+    free(c);
+    return a;
+  }
+  
+  /* An unpooled node can keep the string it is given */
+  a = malloc(sizeof(mpc_ast_t));
+  a->pooled = 0;
+  a->tag = calloc(1, 1);
+  a->tags = 0;
+  a->contents = c;
+  a->state = mpc_state_new();
+  a->children_num = 0;
+  a->children = NULL;
   return a;
 }
 
@@ -2710,11 +4236,11 @@ mpc_parser_t *mpca_state(mpc_parser_t *a) {
 }
 
 mpc_parser_t *mpca_tag(mpc_parser_t *a, const char *t) {
-  return mpc_apply_to(a, (mpc_apply_to_t)mpc_ast_tag, (void*)t);
+  return mpc_apply_to(a, (mpc_apply_to_t)mpc_ast_tag_interned, mpc_tag_intern(t));
 }
 
 mpc_parser_t *mpca_add_tag(mpc_parser_t *a, const char *t) {
-  return mpc_apply_to(a, (mpc_apply_to_t)mpc_ast_add_tag, (void*)t);
+  return mpc_apply_to(a, (mpc_apply_to_t)mpc_ast_add_tag_interned, mpc_tag_intern(t));
 }
 
 mpc_parser_t *mpca_root(mpc_parser_t *a) {
@@ -2824,6 +4350,7 @@ typedef struct {
   int parsers_num;
   mpc_parser_t **parsers;
   int flags;
+  mpc_parser_t *frozen;
 } mpca_grammar_st_t;
 
 static mpc_val_t *mpcaf_grammar_or(int n, mpc_val_t **xs) {
@@ -3081,8 +4608,11 @@ static mpc_val_t *mpca_stmt_list_apply_to(mpc_val_t *x, void *s) {
     stmt = *stmts;
     left = mpca_grammar_find_parser(stmt->ident, st);
     if (st->flags & MPCA_LANG_PREDICTIVE) { stmt->grammar = mpc_predictive(stmt->grammar); }
+    if (st->flags & MPCA_LANG_PACKRAT) {
+      stmt->grammar = mpc_memo(stmt->grammar, (mpc_apply_t)mpc_ast_copy, (mpc_dtor_t)mpc_ast_delete);
+    }
     if (stmt->name) { stmt->grammar = mpc_expect(stmt->grammar, stmt->name); }
-    mpc_define(left, stmt->grammar);
+    if (mpc_define(left, stmt->grammar) == NULL && st->frozen == NULL) { st->frozen = left; }
     free(stmt->ident);
     free(stmt->name);
     free(stmt);
@@ -3097,8 +4627,11 @@ static mpc_err_t *mpca_lang_st(mpc_input_t *i, mpca_grammar_st_t *st) {
   
   mpc_result_t r;
   mpc_err_t *e;
+  char *m;
   mpc_parser_t *Lang, *Stmt, *Grammar, *Term, *Factor, *Base; 
   
+  st->frozen = NULL;
+  
   Lang    = mpc_new("lang");
   Stmt    = mpc_new("stmt");
   Grammar = mpc_new("grammar");
@@ -3149,6 +4682,15 @@ static mpc_err_t *mpca_lang_st(mpc_input_t *i, mpca_grammar_st_t *st) {
     e = r.error;
   } else {
     e = NULL;
+    mpc_analyse(st->parsers_num, st->parsers);
+  }
+  
+  /* The rest of the grammar is defined, but the caller is told it is incomplete */
+  if (e == NULL && st->frozen) {
+    m = malloc(strlen(st->frozen->name ? st->frozen->name : "") + 64);
+    sprintf(m, "Cannot define frozen Parser '%s'!", st->frozen->name ? st->frozen->name : "");
+    e = mpc_err_fail(i->filename, mpc_state_invalid(), m);
+    free(m);
   }
   
   mpc_cleanup(6, Lang, Stmt, Grammar, Term, Factor, Base);
@@ -3169,7 +4711,8 @@ mpc_err_t *mpca_lang_file(int flags, FILE *f, ...) {
   st.parsers = NULL;
   st.flags = flags;
   
-  i = mpc_input_new_file("<mpca_lang_file>", f);
+  i = mpc_input_new_mmap("<mpca_lang_file>", f);
+  if (i == NULL) { i = mpc_input_new_file("<mpca_lang_file>", f); }
   err = mpca_lang_st(i, &st);
   mpc_input_delete(i);
   
@@ -3244,7 +4787,8 @@ mpc_err_t *mpca_lang_contents(int flags, const char *filename, ...) {
   st.parsers = NULL;
   st.flags = flags;
   
-  i = mpc_input_new_file(filename, f);
+  i = mpc_input_new_mmap(filename, f);
+  if (i == NULL) { i = mpc_input_new_file(filename, f); }
   err = mpca_lang_st(i, &st);
   mpc_input_delete(i);
   
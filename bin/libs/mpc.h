@@ -61,10 +61,52 @@ struct mpc_parser_t;
 typedef struct mpc_parser_t mpc_parser_t;
 
 int mpc_parse(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r);
+int mpc_parse_n(const char *filename, const char *string, long length, mpc_parser_t *p, mpc_result_t *r);
 int mpc_parse_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r);
 int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result_t *r);
 int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r);
 
+/*
+** Each thread keeps the stack of its last parse
+** to reuse for the next. `mpc_cleanup` frees the
+** calling thread's; any other thread that parsed
+** should call `mpc_stack_cache_free` before it
+** exits. Compilers with no thread-local storage
+** (other than MSVC, GCC and Clang) keep no stack,
+** and can't give each thread its own AST pool, so
+** there a context with MPC_CONTEXT_POOL_AST must
+** not parse while another thread is parsing.
+*/
+void mpc_stack_cache_free(void);
+
+/*
+** A context keeps the storage a parse needs and
+** reuses it for the next, which makes repeated
+** parsing of small strings cheaper. Contexts are
+** not shared: use one for each thread.
+**
+** With MPC_CONTEXT_POOL_AST every AST node built
+** during a parse comes from a pool the context
+** owns. Such trees are read only, `mpc_ast_delete`
+** does nothing to them, and they stay valid until
+** the context parses again or is deleted. Use
+** `mpc_ast_copy` outside a parse to keep one.
+*/
+
+struct mpc_context_t;
+typedef struct mpc_context_t mpc_context_t;
+
+enum {
+  MPC_CONTEXT_DEFAULT  = 0,
+  MPC_CONTEXT_POOL_AST = 1
+};
+
+mpc_context_t *mpc_context_new(int flags);
+void mpc_context_delete(mpc_context_t *c);
+
+int mpc_context_parse(mpc_context_t *c, const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r);
+int mpc_context_parse_n(mpc_context_t *c, const char *filename, const char *string, long length, mpc_parser_t *p, mpc_result_t *r);
+
 /*
 ** Function Types
 */
@@ -80,6 +122,15 @@ typedef mpc_val_t*(*mpc_fold_t)(int,mpc_val_t**);
 ** Building a Parser
 */
 
+/*
+** Redefining or undefining a parser makes the
+** lookahead of any `mpc_or` that reaches it be
+** worked out again on its next use. This frees
+** the old tables, so a parser must not be changed
+** while a parse that uses it is running, such as
+** from inside an `mpc_apply` callback.
+*/
+
 mpc_parser_t *mpc_new(const char *name);
 mpc_parser_t *mpc_define(mpc_parser_t *p, mpc_parser_t *a);
 mpc_parser_t *mpc_undefine(mpc_parser_t *p);
@@ -87,6 +138,20 @@ mpc_parser_t *mpc_undefine(mpc_parser_t *p);
 void mpc_delete(mpc_parser_t *p);
 void mpc_cleanup(int n, ...);
 
+/*
+** Freezing a parser works out its lookahead and
+** marks every parser it uses as fixed. A frozen
+** grammar is never written to by a parse, so any
+** number of threads can parse with it at once,
+** each with its own context. `mpc_define` will
+** not change a frozen parser: it prints an error
+** to stderr, deletes the new definition and gives
+** NULL, and `mpca_lang` returns an error naming
+** the parser. Undefine or delete frozen parsers
+** only once no thread is parsing with them.
+*/
+void mpc_freeze(mpc_parser_t *p);
+
 /*
 ** Basic Parsers
 */
@@ -134,6 +199,13 @@ mpc_parser_t *mpc_and(int n, mpc_fold_t f, ...);
 
 mpc_parser_t *mpc_predictive(mpc_parser_t *a);
 
+/*
+** Packrat memoisation: results of `a` are cached
+** by input position, `cf` copies a result out of
+** the cache and `da` deletes one.
+*/
+mpc_parser_t *mpc_memo(mpc_parser_t *a, mpc_apply_t cf, mpc_dtor_t da);
+
 /*
 ** Common Parsers
 */
@@ -261,9 +333,23 @@ typedef struct mpc_ast_t {
   mpc_state_t state;
   int children_num;
   struct mpc_ast_t** children;
+  unsigned long tags;
+  int pooled;
 } mpc_ast_t;
 
+/*
+** Every name used in a tag is given a bit of its
+** own, while there are bits left, and `tags` holds
+** the bits of each name in `tag`. So a test such
+** as `a->tags & mpc_tag_flag("number")` needs no
+** string compare. Names are registered when the
+** grammar is built; call this before parsing on
+** other threads. It gives 0 once bits run out.
+*/
+unsigned long mpc_tag_flag(const char *name);
+
 mpc_ast_t *mpc_ast_new(const char *tag, const char *contents);
+mpc_ast_t *mpc_ast_copy(mpc_ast_t *a);
 mpc_ast_t *mpc_ast_build(int n, const char *tag, ...);
 mpc_ast_t *mpc_ast_add_root(mpc_ast_t *a);
 mpc_ast_t *mpc_ast_add_child(mpc_ast_t *r, mpc_ast_t *a);
@@ -303,7 +389,8 @@ mpc_parser_t *mpca_and(int n, ...);
 enum {
   MPCA_LANG_DEFAULT              = 0,
   MPCA_LANG_PREDICTIVE           = 1,
-  MPCA_LANG_WHITESPACE_SENSITIVE = 2
+  MPCA_LANG_WHITESPACE_SENSITIVE = 2,
+  MPCA_LANG_PACKRAT              = 4
 };
 
 mpc_parser_t *mpca_grammar(int flags, const char *grammar, ...);